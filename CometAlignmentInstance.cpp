@@ -50,6 +50,8 @@
 #include "CometAlignmentInstance.h"
 #include "CometAlignmentInterface.h"
 #include "CometAlignmentModule.h" // for ReadableVersion()
+#include "ImagePool.h"
+#include "WarpEngine.h"
 
 #include <pcl/ErrorHandler.h>
 #include <pcl/FileFormat.h>
@@ -66,8 +68,6 @@
 namespace pcl
 {
 
-static PixelInterpolation* pixelInterpolation = 0;
-
 CometAlignmentInstance::CometAlignmentInstance (const MetaProcess* m) :
 ProcessImplementation (m),
 p_targetFrames (),
@@ -86,10 +86,15 @@ p_normalize (TheNormalize->DefaultValue ()),
 p_enableLinearFit (TheEnableLinearFit->DefaultValue ()),
 p_rejectLow (TheRejectLow->DefaultValue ()),
 p_rejectHigh (TheRejectHigh->DefaultValue ()),
+p_linearFitSamples (uint32 (TheLinearFitSamples->DefaultValue ())),
 p_drzSaveSA (TheDrzSaveSA->DefaultValue ()),
 p_drzSaveCA (TheDrzSaveCA->DefaultValue ()),
+p_useROI (TheUseROI->DefaultValue ()),
+p_roi (0),
+p_binning (int32 (TheBinning->DefaultValue ())),
 p_pixelInterpolation (ThePixelInterpolationParameter->DefaultValueIndex ()),
-p_linearClampingThreshold (TheLinearClampingThresholdParameter->DefaultValue ()) { }
+p_linearClampingThreshold (TheLinearClampingThresholdParameter->DefaultValue ()),
+p_floatWorkingPrecision (TheFloatWorkingPrecision->DefaultValue ()) { }
 
 CometAlignmentInstance::CometAlignmentInstance (const CometAlignmentInstance& x) :
 ProcessImplementation (x)
@@ -115,13 +120,18 @@ void CometAlignmentInstance::Assign (const ProcessImplementation& p)
       p_enableLinearFit = x->p_enableLinearFit;
       p_rejectLow = x->p_rejectLow;
       p_rejectHigh = x->p_rejectHigh;
+      p_linearFitSamples = x->p_linearFitSamples;
       p_normalize = x->p_normalize;
 	  p_drzSaveSA = x->p_drzSaveSA;
 	  p_drzSaveCA = x->p_drzSaveCA;
+      p_useROI = x->p_useROI;
+      p_roi = x->p_roi;
+      p_binning = x->p_binning;
       p_subtractMode = x->p_subtractMode;
 	  p_OperandIsDI = x->p_OperandIsDI,
       p_pixelInterpolation = x->p_pixelInterpolation;
       p_linearClampingThreshold = x->p_linearClampingThreshold;
+      p_floatWorkingPrecision = x->p_floatWorkingPrecision;
    }
 }
 
@@ -145,6 +155,8 @@ bool CometAlignmentInstance::CanExecuteGlobal (String& whyNot) const
       whyNot = "The specified output directory does not exist: " + p_outputDir;
    else if (!p_subtractFile.IsEmpty () && !File::Exists (p_subtractFile))
       whyNot = "The specified file for LinearFit does not exist: " + p_subtractFile;
+   else if (p_useROI && !p_roi.Ordered ().IsRect ())
+      whyNot = "The specified region of interest is empty.";
 
    else
    {
@@ -200,13 +212,101 @@ static void DImage2ImageWindow( const DImage* img )
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Deterministic stratified sample of a width x height frame for the linear
+ * fit: a jittered grid of about n cells with one pixel per cell, at a hashed
+ * position inside the cell. With n = 0, or n not smaller than the number of
+ * pixels, every pixel is used.
+ */
+class FitSampling
+{
+public:
+
+   FitSampling (int w, int h, size_type n) : width (w), height (h), step (1)
+   {
+      if (n > 0 && double (n) < double (w)*h)
+         step = Sqrt (double (w)*h/n);
+   }
+
+   bool IsSubsampled () const
+   {
+      return step > 1;
+   }
+
+   int Columns () const
+   {
+      return int (Ceil (width/step));
+   }
+
+   int Rows () const
+   {
+      return int (Ceil (height/step));
+   }
+
+   // cell row containing the pixel row y
+   int CellRow (int y) const
+   {
+      int k = int (y/step);
+      while (k > 0 && Boundary (k) > y)
+         --k;
+      while (Boundary (k + 1) <= y)
+         ++k;
+      return k;
+   }
+
+   // sampled pixel of the cell (cx,cy)
+   Point Sample (int cx, int cy) const
+   {
+      int x0 = Boundary (cx), x1 = Min (width, Boundary (cx + 1));
+      int y0 = Boundary (cy), y1 = Min (height, Boundary (cy + 1));
+      return Point (x0 + int (Hash (cx, cy, 0) % uint32 (x1 - x0)),
+                    y0 + int (Hash (cx, cy, 1) % uint32 (y1 - y0)));
+   }
+
+private:
+
+   int width, height;
+   double step; // cell size in pixels
+
+   int Boundary (int k) const
+   {
+      return int (k*step);
+   }
+
+   static uint32 Hash (uint32 x, uint32 y, uint32 k)
+   {
+      uint32 h = x*0x9E3779B1u ^ y*0x85EBCA77u ^ k*0xC2B2AE3Du;
+      h ^= h >> 16;
+      h *= 0x7FEB352Du;
+      h ^= h >> 15;
+      h *= 0x846CA68Bu;
+      h ^= h >> 16;
+      return h;
+   }
+};
+
+// ----------------------------------------------------------------------------
+
 class LinearFitEngine
 {
 public:
 
    typedef GenericVector<LinearFit> linear_fit_set;
 
-   LinearFitEngine (const float _rejectLow, const float _rejectHigh) : rejectLow (_rejectLow), rejectHigh (_rejectHigh) 
+   // standard errors of the coefficients of a linear fit
+   struct FitError
+   {
+      double a, b;
+
+      FitError () : a (0), b (0)
+      {
+      }
+   };
+
+   typedef GenericVector<FitError> fit_error_set;
+
+   LinearFitEngine (const float _rejectLow, const float _rejectHigh, size_type _samples = 0, int _threads = 1) :
+   rejectLow (_rejectLow), rejectHigh (_rejectHigh), samples (_samples), threads (_threads)
    {
    }
 
@@ -250,88 +350,627 @@ public:
          if (image.IsFloatSample ())
             switch (image.BitsPerSample ())
             {
-            case 32: Apply (static_cast<Image&> (*image), L);
+            case 32: Apply<float> (static_cast<Image&> (*image), L);
                break;
-            case 64: Apply (static_cast<DImage&> (*image), L);
+            case 64: Apply<double> (static_cast<DImage&> (*image), L);
                break;
             }
          else
             switch (image.BitsPerSample ())
             {
-            case 8:
-            {
-               UInt8Image& wrk = static_cast<UInt8Image&> (*image);
-               Image tmp (wrk);
-               Apply (tmp, L);
-               wrk.Apply (tmp);
-            }
+            case 8: Apply<float> (static_cast<UInt8Image&> (*image), L);
                break;
-            case 16:
-            {
-               UInt16Image& wrk = static_cast<UInt16Image&> (*image);
-               Image tmp (wrk);
-               Apply (tmp, L);
-               wrk.Apply (tmp);
-            }
+            case 16: Apply<float> (static_cast<UInt16Image&> (*image), L);
                break;
-            case 32:
-            {
-               UInt32Image& wrk = static_cast<UInt32Image&> (*image);
-               DImage tmp (wrk);
-               Apply (tmp, L);
-               wrk.Apply (tmp);
-            }
+            case 32: Apply<double> (static_cast<UInt32Image&> (*image), L);
                break;
             }
    }
 
+   /*
+    * Applies L to the samples [v,vN) in their native type, computing in T.
+    * For integer samples the fit is scaled to the sample range and rounded,
+    * as a conversion through [0,1] would do. The black pixel rule and the
+    * truncation are selects rather than branches, so the loop vectorizes.
+    */
+   template <class T, class P>
+   static void ApplyToSamples (typename P::sample* v, const typename P::sample* vN, const LinearFit& L)
+   {
+      const T s = P::IsFloatSample () ? T (1) : T (P::MaxSampleValue ());
+      const T r = P::IsFloatSample () ? T (0) : T (0.5);
+      const T a = T (L.a)*s, b = T (L.b);
+      for (; v < vN; ++v)
+      {
+         T f = T (*v);
+         T g = a + b*f;
+         g = (g < 0) ? T (0) : g;
+         g = (g > s) ? s : g;
+         *v = typename P::sample ((f > 0) ? g + r : T (0)); //ignore black pixels
+      }
+   }
+
+   bool Accepts (float f) const //sample usable for the fit
+   {
+      return f > rejectLow && f < rejectHigh;
+   }
+
+   size_type Samples () const //size of the stratified sample, 0 == every pixel
+   {
+      return samples;
+   }
+
+   // standard errors of the coefficients of the last Fit(), by channel
+   const fit_error_set& Errors () const
+   {
+      return errors;
+   }
+
+   /*
+    * Standard errors of the coefficients of the fit L of n samples whose
+    * abscissas have the sums sx and sxx. The residuals are taken as normal,
+    * with sigma = adev*Sqrt(Pi/2), and the errors of the L1 fit are
+    * Sqrt(Pi/2) times those of the least squares fit.
+    */
+   static FitError StandardError (const LinearFit& L, double n, double sx, double sxx)
+   {
+      FitError e;
+      double m = sx/n;
+      double d = sxx - sx*m;
+      if (d > 0)
+      {
+         double k = L.adev*Const<double>::pi ()/2;
+         e.b = k/Sqrt (d);
+         e.a = k*Sqrt (1/n + m*m/d);
+      }
+      return e;
+   }
+
 private:
 
    const float rejectLow;
    const float rejectHigh;
+   const size_type samples;
+   const int threads; // intra-frame threads for Fit() and Apply()
+   fit_error_set errors;
+
+   enum { BlockRows = 16 }; // rows of the partial sums of a parallel fit pass
+
+   /*
+    * Weighted least squares sums of the accepted sample pairs (x,y), each
+    * pair standing for m coincident samples. With weighted = true, each pair
+    * has the weight 1/|r| of the L1 norm, r being its residual from the line
+    * y = a + b*x, and the sum of |r| is gathered.
+    */
+   struct FitSums
+   {
+      double a, b;
+      bool weighted;
+      double n, s, sx, sy, sxx, sxy, dev;
+
+      FitSums (double _a, double _b, bool _weighted) : a (_a), b (_b), weighted (_weighted),
+      n (0), s (0), sx (0), sy (0), sxx (0), sxy (0), dev (0)
+      {
+      }
 
-   template <class P1, class P2>
-   linear_fit_set
-   Fit (const GenericImage<P1>& image, const GenericImage<P2>& reference)
+      void operator () (double x, double y, double m = 1)
+      {
+         double w = m;
+         if (weighted)
+         {
+            double r = Abs (y - a - b*x);
+            dev += m*r;
+            w = m/Max (r, 1.0e-09);
+         }
+         n += m;
+         s += w;
+         sx += w*x;
+         sy += w*y;
+         sxx += w*x*x;
+         sxy += w*x*y;
+      }
+
+      void operator += (const FitSums& S)
+      {
+         n += S.n;
+         s += S.s;
+         sx += S.sx;
+         sy += S.sy;
+         sxx += S.sxx;
+         sxy += S.sxy;
+         dev += S.dev;
+      }
+
+      bool Solve (double& a1, double& b1) const
+      {
+         double d = s*sxx - sx*sx;
+         if (d == 0)
+            return false;
+         b1 = (s*sxy - sx*sy)/d;
+         a1 = (sy - b1*sx)/s;
+         return true;
+      }
+   };
+
+   // rows visited by Scan(): pixel rows, or cell rows of the stratified sample
+   template <class P>
+   int ScanRows (const GenericImage<P>& image) const
    {
-      linear_fit_set L (image.NumberOfNominalChannels ());
-      GenericVector<size_type> count (image.NumberOfNominalChannels ());
-      size_type N = image.NumberOfPixels ();
+      FitSampling grid (image.Width (), image.Height (), samples);
+      return grid.IsSubsampled () ? grid.Rows () : image.Height ();
+   }
 
-      for (int c = 0; c < image.NumberOfNominalChannels (); ++c)
+   // one pass of S over the accepted sample pairs of channel c in the scan rows [r0,r1)
+   template <class P1, class P2, class S_>
+   void Scan (S_& S, const GenericImage<P1>& image, const GenericImage<P2>& reference, int c, int r0, int r1) const
+   {
+      FitSampling grid (image.Width (), image.Height (), samples);
+      if (grid.IsSubsampled ())
       {
-         Array<float> F1, F2;
-         F1.Reserve (N);
-         F2.Reserve (N);
-         const typename P1::sample* v1 = image.PixelData (c);
-         const typename P1::sample* vN = v1 + N;
-         const typename P2::sample* v2 = reference.PixelData (c);
-         for (; v1 < vN; ++v1, ++v2)
-         {
-            float f1;
-            P1::FromSample (f1, *v1);
-            if (f1 > rejectLow && f1 < rejectHigh)
+         const typename P1::sample* p1 = image.PixelData (c);
+         const typename P2::sample* p2 = reference.PixelData (c);
+         for (int cy = r0, nx = grid.Columns (); cy < r1; ++cy)
+            for (int cx = 0; cx < nx; ++cx)
             {
-               float f2;
-               P2::FromSample (f2, *v2);
-               if (f2 > rejectLow && f2 < rejectHigh)
+               Point p = grid.Sample (cx, cy);
+               size_type k = size_type (p.y)*image.Width () + p.x;
+               float f1;
+               P1::FromSample (f1, p1[k]);
+               if (Accepts (f1))
                {
-                  F1.Add (f1);
-                  F2.Add (f2);
+                  float f2;
+                  P2::FromSample (f2, p2[k]);
+                  if (Accepts (f2))
+                     S (f1, f2);
                }
             }
+         return;
+      }
+
+      const typename P1::sample* v1 = image.PixelData (c) + size_type (r0)*image.Width ();
+      const typename P1::sample* vN = image.PixelData (c) + size_type (r1)*image.Width ();
+      const typename P2::sample* v2 = reference.PixelData (c) + size_type (r0)*image.Width ();
+      for (; v1 < vN; ++v1, ++v2)
+      {
+         float f1;
+         P1::FromSample (f1, *v1);
+         if (Accepts (f1))
+         {
+            float f2;
+            P2::FromSample (f2, *v2);
+            if (Accepts (f2))
+               S (f1, f2);
          }
+      }
+   }
+
+   template <class D, class S_>
+   class ScanTask : public WarpBandTask
+   {
+   public:
+
+      ScanTask (const D& data, Array<S_>& S, int rows) : WarpBandTask (0), data (data), S (S), rows (rows)
+      {
+      }
+
+      virtual void Run (int b0, int b1)
+      {
+         for (int b = b0; b < b1; ++b)
+            data.Scan (S[b], b*BlockRows, Min ((b + 1)*BlockRows, rows));
+      }
+
+   private:
+
+      const D& data;
+      Array<S_>& S;
+      int rows;
+   };
+
+   /*
+    * One pass of S over the sample pairs D on the intra-frame threads. Each
+    * block of BlockRows scan rows accumulates into its own copy of S, and the
+    * partial sums are merged in block order, so the result does not depend on
+    * the number of threads.
+    */
+   template <class D, class S_>
+   static void ScanBlocks (const D& data, S_& S, int threads)
+   {
+      int rows = data.Rows ();
+      int blocks = (rows + BlockRows - 1)/BlockRows;
+      Array<S_> B (size_type (blocks), S);
+      ScanTask<D, S_> task (data, B, rows);
+      RunWarpBands (task, blocks, threads);
+      for (int b = 0; b < blocks; ++b)
+         S += B[b];
+   }
+
+   // the accepted sample pairs of channel c of two images
+   template <class P1, class P2>
+   class PixelPairs
+   {
+   public:
 
-         if (F1.Length () < 3)
-            throw Error ("Insufficient data (channel " + String (c) + ')');
+      PixelPairs (const LinearFitEngine& E, const GenericImage<P1>& image, const GenericImage<P2>& reference, int c) :
+      E (E), image (image), reference (reference), c (c)
+      {
+      }
 
-         count[c] = F1.Length ();
+      int Rows () const
+      {
+         return E.ScanRows (image);
+      }
+
+      int Threads () const
+      {
+         return E.threads;
+      }
 
-         L[c] = LinearFit (F1, F2);
+      template <class S_>
+      void Scan (S_& S, int r0, int r1) const
+      {
+         E.Scan (S, image, reference, c, r0, r1);
+      }
 
-         if (!L[c].IsValid ())
-            throw Error ("Invalid linear fit (channel " + String (c) + ')');
+      template <class S_>
+      void Scan (S_& S) const
+      {
+         ScanBlocks (*this, S, E.threads);
       }
+
+   private:
+
+      const LinearFitEngine& E;
+      const GenericImage<P1>& image;
+      const GenericImage<P2>& reference;
+      int c;
+   };
+
+public:
+
+   /*
+    * Upper bound of the pairs kept by SamplePairs when the fit has no sample
+    * budget: larger frames are sampled on a FitSampling grid of this size.
+    */
+   enum { MaxStreamedPairs = 1 << 22 }; // 32 MiB per channel
+
+   // stratified sample of a width x height frame for a streamed fit
+   FitSampling StreamedSampling (int width, int height) const
+   {
+      size_type n = samples;
+      if (n == 0 && double (width)*height > MaxStreamedPairs)
+         n = MaxStreamedPairs;
+      return FitSampling (width, height, n);
+   }
+
+   /*
+    * Accepted sample pairs of a channel, stored as they are streamed. Each
+    * pair has a slot of its own, (row,column) in the scan rows of a
+    * FitSampling grid, so distinct rows can be stored concurrently without
+    * locking, and the pairs are scanned in the order of the pixels of the
+    * in-place fit: the fit is exactly the one of the same pairs read from
+    * two images.
+    */
+   class SamplePairs
+   {
+   public:
+
+      SamplePairs (const LinearFitEngine& E, int rows, int columns) :
+      threads (E.threads), rows (rows), columns (columns),
+      x (size_type (rows)*columns, -1.0F), y (size_type (rows)*columns, 0.0F)
+      {
+      }
+
+      int Rows () const
+      {
+         return rows;
+      }
+
+      int Threads () const
+      {
+         return threads;
+      }
+
+      void Set (int row, int column, float f1, float f2)
+      {
+         size_type k = size_type (row)*columns + column;
+         x[k] = f1;
+         y[k] = f2;
+      }
+
+      template <class S_>
+      void Scan (S_& S, int r0, int r1) const
+      {
+         for (size_type k = size_type (r0)*columns, kN = size_type (r1)*columns; k < kN; ++k)
+            if (x[k] >= 0) // empty slots are negative
+               S (x[k], y[k]);
+      }
+
+      template <class S_>
+      void Scan (S_& S) const
+      {
+         ScanBlocks (*this, S, threads);
+      }
+
+   private:
+
+      int threads, rows, columns;
+      Array<float> x, y;
+   };
+
+   /*
+    * Joint histogram of the accepted sample pairs of a channel. Each cell keeps the count of the pairs that fall in it and the sums of
+    * their values, and the fit runs on the mean pair of each occupied cell
+    * weighted by its count, so binning merges nearby pairs without moving
+    * them to the cell centers. The sums are fixed point integers: histograms
+    * add up exactly in any order, and the fit does not depend on the number
+    * of threads. The memory used is bounded by MaxBins^2 cells whatever the
+    * frame size.
+    */
+   class JointHistogram
+   {
+   public:
+
+      enum { MaxBins = 512 };
+
+      /*
+       * Histogram of the sample pairs D (PixelPairs or SamplePairs) of 8-bit
+       * or 16-bit integer samples, xmax and ymax being their maximum sample
+       * values. Each axis spans the range of accepted values in bins of whole
+       * sample values, one value per bin when the range allows it, so 8-bit
+       * data are binned exactly.
+       */
+      template <class D>
+      JointHistogram (const D& data, double xmax, double ymax) : threads (data.Threads ())
+      {
+         Extent R (xmax, ymax);
+         data.Scan (R);
+         if (R.x1 < R.x0)
+            return; // no accepted pairs
+         x.Set (R.x0, R.x1, R.xmax);
+         y.Set (R.y0, R.y1, R.ymax);
+         H = Array<Cell> (size_type (x.bins)*y.bins);
+         FillTask<D> task (data, *this);
+         RunWarpBands (task, data.Rows (), threads);
+      }
+
+      // accumulates a sample pair
+      void operator () (float f1, float f2)
+      {
+         Cell& h = H[size_type (y.Bin (f2))*x.bins + x.Bin (f1)];
+         ++h.n;
+         h.sx += Fixed (f1);
+         h.sy += Fixed (f2);
+      }
+
+      void operator += (const JointHistogram& h)
+      {
+         for (size_type i = 0; i < H.Length (); ++i)
+         {
+            H[i].n += h.H[i].n;
+            H[i].sx += h.H[i].sx;
+            H[i].sy += h.H[i].sy;
+         }
+      }
+
+      /*
+       * One pass of S over the occupied cells on the intra-frame threads.
+       * Each row of cells accumulates into its own copy of S, and the rows
+       * are merged in order, so the result does not depend on the number of
+       * threads.
+       */
+      void Scan (FitSums& S) const
+      {
+         Array<FitSums> B (size_type (y.bins), S);
+         SumTask task (*this, B);
+         RunWarpBands (task, y.bins, threads);
+         for (int j = 0; j < y.bins; ++j)
+            S += B[j];
+      }
+
+   private:
+
+      JointHistogram (const JointHistogram& h, bool) : x (h.x), y (h.y), threads (h.threads), H (h.H.Length ())
+      {
+      }
+
+      static const double Unit; // fixed point unit of the sums
+
+      static uint64 Fixed (double f)
+      {
+         return uint64 (f*Unit + 0.5);
+      }
+
+      class SumTask : public WarpBandTask
+      {
+      public:
+
+         SumTask (const JointHistogram& h, Array<FitSums>& S) : WarpBandTask (0), h (h), S (S)
+         {
+         }
+
+         virtual void Run (int j0, int j1)
+         {
+            for (int j = j0; j < j1; ++j)
+            {
+               const Cell* c = h.H.Begin () + size_type (j)*h.x.bins;
+               for (const Cell* cN = c + h.x.bins; c < cN; ++c)
+                  if (c->n != 0)
+                     S[j] (c->sx/(Unit*c->n), c->sy/(Unit*c->n), c->n);
+            }
+         }
+
+      private:
+
+         const JointHistogram& h;
+         Array<FitSums>& S;
+      };
+
+      // each band counts in its own histogram, added to the total under a lock
+      template <class D>
+      class FillTask : public WarpBandTask
+      {
+      public:
+
+         FillTask (const D& data, JointHistogram& total) : WarpBandTask (0), data (data), total (total)
+         {
+         }
+
+         virtual void Run (int r0, int r1)
+         {
+            JointHistogram h (total, true);
+            data.Scan (h, r0, r1);
+            mutex.Lock ();
+            total += h;
+            mutex.Unlock ();
+         }
+
+      private:
+
+         const D& data;
+         JointHistogram& total;
+         Mutex mutex;
+      };
+
+      // pairs in a cell and the sums of their values, in units of 1/Unit
+      struct Cell
+      {
+         uint32 n;
+         uint64 sx, sy;
+
+         Cell () : n (0), sx (0), sy (0)
+         {
+         }
+      };
+
+      struct Axis
+      {
+         double lo, scale; // the bin i spans [lo + i/scale, lo + (i+1)/scale)
+         int bins;
+
+         Axis () : lo (0), scale (1), bins (0)
+         {
+         }
+
+         // bins of whole sample values for the values [v0,v1] of samples in [0,max]
+         void Set (int v0, int v1, double max)
+         {
+            int step = (v1 - v0)/MaxBins + 1;
+            bins = (v1 - v0)/step + 1;
+            lo = (v0 - 0.5)/max;
+            scale = max/step;
+         }
+
+         int Bin (double f) const
+         {
+            return Range (int ((f - lo)*scale), 0, bins - 1);
+         }
+      };
+
+      // range of the accepted sample values of each image
+      struct Extent
+      {
+         double xmax, ymax;
+         int x0, x1, y0, y1;
+
+         Extent (double _xmax, double _ymax) : xmax (_xmax), ymax (_ymax),
+         x0 (int_max), x1 (int_min), y0 (int_max), y1 (int_min)
+         {
+         }
+
+         void operator () (float f1, float f2)
+         {
+            int v1 = RoundInt (f1*xmax), v2 = RoundInt (f2*ymax);
+            if (v1 < x0) x0 = v1;
+            if (v1 > x1) x1 = v1;
+            if (v2 < y0) y0 = v2;
+            if (v2 > y1) y1 = v2;
+         }
+
+         void operator += (const Extent& e)
+         {
+            x0 = Min (x0, e.x0);
+            x1 = Max (x1, e.x1);
+            y0 = Min (y0, e.y0);
+            y1 = Max (y1, e.y1);
+         }
+      };
+
+      Axis x, y;
+      int threads;
+      Array<Cell> H; // y-major cells
+   };
+
+   /*
+    * Fit of channel c minimizing the mean absolute deviation, as
+    * pcl::LinearFit does, without gathering the samples: the least squares
+    * line is refined by iteratively reweighted least squares with L1 weights,
+    * one pass of D.Scan() per iteration, until the line is stable to
+    * 1.0e-07. D provides the sample pairs as PixelPairs, SamplePairs or
+    * JointHistogram.
+    */
+   template <class D>
+   static LinearFit FitChannel (const D& data, int c, FitError& e)
+   {
+      FitSums S0 (0, 0, false);
+      data.Scan (S0);
+      if (S0.n < 3)
+         throw Error ("Insufficient data (channel " + String (c) + ')');
+
+      double a, b;
+      if (!S0.Solve (a, b))
+         throw Error ("Invalid linear fit (channel " + String (c) + ')');
+
+      LinearFit L;
+      L.a = a;
+      L.b = b;
+      for (int k = 0; k < 50; ++k)
+      {
+         FitSums S (a, b, true);
+         data.Scan (S);
+         double adev = S.dev/S.n;
+         if (k > 0 && adev > L.adev)
+            break;
+         L.a = a;
+         L.b = b;
+         L.adev = adev;
+         double a1, b1;
+         if (!S.Solve (a1, b1))
+            break;
+         bool stable = Abs (a1 - a) < 1.0e-07 && Abs (b1 - b) < 1.0e-07*Max (1.0, Abs (b));
+         a = a1;
+         b = b1;
+         if (stable)
+            break;
+      }
+
+      if (!L.IsValid ())
+         throw Error ("Invalid linear fit (channel " + String (c) + ')');
+      e = StandardError (L, S0.n, S0.sx, S0.sxx);
+      return L;
+   }
+
+   /*
+    * Fit of channel c of the sample pairs D of two images of sample types P1
+    * and P2: on their joint histogram when both are 8-bit or 16-bit integers,
+    * on the pairs themselves otherwise.
+    */
+   template <class P1, class P2, class D>
+   static LinearFit FitPairs (const D& data, int c, FitError& e)
+   {
+      if (!P1::IsFloatSample () && P1::BitsPerSample () <= 16 && !P2::IsFloatSample () && P2::BitsPerSample () <= 16)
+         return FitChannel (JointHistogram (data, P1::MaxSampleValue (), P2::MaxSampleValue ()), c, e);
+      return FitChannel (data, c, e);
+   }
+
+private:
+
+   template <class P1, class P2>
+   linear_fit_set
+   Fit (const GenericImage<P1>& image, const GenericImage<P2>& reference)
+   {
+      linear_fit_set L (image.NumberOfNominalChannels ());
+      errors = fit_error_set (image.NumberOfNominalChannels ());
+      for (int c = 0; c < image.NumberOfNominalChannels (); ++c)
+         L[c] = FitPairs<P1, P2> (PixelPairs<P1, P2> (*this, image, reference, c), c, errors[c]);
       return L;
    }
 
@@ -361,29 +1000,453 @@ private:
       return linear_fit_set ();
    }
 
-   template <class P>
-   void
-   Apply (GenericImage<P>& image, const linear_fit_set& L)
+   // applies L to the rows [y0,y1) of the nominal channels, truncating to [0,1]
+   template <class T, class P>
+   class ApplyTask : public WarpBandTask
+   {
+   public:
+
+      ApplyTask (GenericImage<P>& image, const linear_fit_set& L) : WarpBandTask (0), image (image), L (L)
+      {
+      }
+
+      virtual void Run (int y0, int y1)
+      {
+         for (int c = 0; c < image.NumberOfNominalChannels (); ++c)
+            ApplyToSamples<T, P> (image.PixelData (c) + size_type (y0)*image.Width (),
+                                  image.PixelData (c) + size_type (y1)*image.Width (), L[c]);
+      }
+
+   private:
+
+      GenericImage<P>& image;
+      const linear_fit_set& L;
+   };
+
+   template <class T, class P>
+   void
+   Apply (GenericImage<P>& image, const linear_fit_set& L)
+   {
+      ApplyTask<T, P> task (image, L);
+      RunWarpBands (task, image.Height (), threads);
+      if (image.HasAlphaChannels ())
+         image.Truncate ();
+   }
+};
+
+const double LinearFitEngine::JointHistogram::Unit = 16777216.0; // 2^24
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Fused subtraction of a warped operand image from a target image.
+ *
+ * The operand is warped with WarpEngine::Stream() and each of its rows is
+ * consumed as soon as it has been interpolated, so the warped operand never
+ * exists as an image. When LinearFit or normalization are enabled, a first
+ * streamed pass with OperandStatistics stores the fit pairs and accumulates
+ * the histogram of the operand, both of bounded size. The pairs are fitted
+ * as the in-place LinearFitEngine::Fit() fits those of two images, on the
+ * same stratified sample, except that frames of more than
+ * LinearFitEngine::MaxStreamedPairs pixels are sampled when the fit has no
+ * sample budget. OperandSubtraction then fits and normalizes each
+ * operand sample, subtracts it from the target and truncates the result to
+ * [0,1], all in a single pass over the target. The operand is streamed with
+ * the geometry of the target. An operand already in target coordinates is
+ * fed to the same sinks row by row with ImageRowsTask.
+ */
+template <class P, class Q>
+class OperandStatistics : public WarpRowSink<P>
+{
+public:
+
+   enum { Bins = 65536 }; // median resolution: exact for 8-bit and 16-bit operands
+
+   OperandStatistics (const GenericImage<P>& operand, const GenericImage<Q>& target, const LinearFitEngine* fit, bool histogram) :
+   target (target), fit (fit),
+   channels (Min (operand.NumberOfNominalChannels (), target.NumberOfChannels ())),
+   width (target.Width ()),
+   grid ((fit != 0) ? fit->StreamedSampling (target.Width (), target.Height ()) : FitSampling (target.Width (), target.Height (), 0)),
+   histogram (histogram)
+   {
+      if (fit == 0)
+         return;
+      int h = target.Height ();
+      for (int c = 0; c < channels; ++c)
+         pairs.Add (grid.IsSubsampled () ? new LinearFitEngine::SamplePairs (*fit, grid.Rows (), grid.Columns ()) :
+                                           new LinearFitEngine::SamplePairs (*fit, h, width));
+      if (grid.IsSubsampled ())
+      {
+         // sampled cells of each row, in the order of the cells
+         rowStart = Array<int> (size_type (h + 1), 0);
+         cellRow = Array<int> (size_type (h), 0);
+         for (int cy = 0, ny = grid.Rows (); cy < ny; ++cy)
+            for (int cx = 0, nx = grid.Columns (); cx < nx; ++cx)
+            {
+               Point p = grid.Sample (cx, cy);
+               ++rowStart[p.y + 1];
+               cellRow[p.y] = cy;
+            }
+         for (int y = 0; y < h; ++y)
+            rowStart[y + 1] += rowStart[y];
+         rowColumns = Array<int> (size_type (rowStart[h]));
+         rowCells = Array<int> (size_type (rowStart[h]));
+         Array<int> next (rowStart.Begin (), rowStart.End () - 1);
+         for (int cy = 0, ny = grid.Rows (); cy < ny; ++cy)
+            for (int cx = 0, nx = grid.Columns (); cx < nx; ++cx)
+            {
+               Point p = grid.Sample (cx, cy);
+               rowColumns[next[p.y]] = p.x;
+               rowCells[next[p.y]++] = cx;
+            }
+      }
+   }
+
+   virtual ~OperandStatistics ()
+   {
+      pairs.Destroy ();
+      histograms.Destroy ();
+   }
+
+   virtual void Row (int y, const typename P::sample* const* row)
+   {
+      if (fit != 0)
+         for (int c = 0; c < channels; ++c) // each row has slots of its own: no locking
+         {
+            const typename P::sample* v1 = row[c];
+            const typename Q::sample* v2 = target.PixelData (c) + size_type (y)*target.Width ();
+            LinearFitEngine::SamplePairs& d = *pairs[c];
+            if (grid.IsSubsampled ())
+            {
+               for (int i = rowStart[y], iN = rowStart[y + 1]; i < iN; ++i)
+                  Gather (d, cellRow[y], rowCells[i], v1[rowColumns[i]], v2[rowColumns[i]]);
+            }
+            else
+               for (int x = 0; x < width; ++x)
+                  Gather (d, y, x, v1[x], v2[x]);
+         }
+
+      if (histogram)
+      {
+         Array<size_type>* H = AcquireHistogram ();
+         for (int c = 0; c < channels; ++c)
+         {
+            const typename P::sample* v1 = row[c];
+            size_type* h = H->Begin () + size_type (c)*(Bins + 1);
+            for (int x = 0; x < width; ++x)
+               ++h[Bin (v1[x])];
+         }
+         ReleaseHistogram (H);
+      }
+   }
+
+   int NumberOfChannels () const
+   {
+      return channels;
+   }
+
+   LinearFitEngine::linear_fit_set Fit (LinearFitEngine::fit_error_set& E) const
+   {
+      LinearFitEngine::linear_fit_set L (channels);
+      E = LinearFitEngine::fit_error_set (channels);
+      for (int c = 0; c < channels; ++c)
+         L[c] = LinearFitEngine::FitPairs<P, Q> (*pairs[c], c, E[c]);
+      return L;
+   }
+
+   // true if each histogram bin holds a single sample value, so that the medians need no refinement
+   static bool IsExact ()
+   {
+      return !P::IsFloatSample () && P::BitsPerSample () <= 16;
+   }
+
+   /*
+    * Medians of the operand, after the optional linear fit L and its
+    * truncation to [0,1], as subtracted by the normalization. As with
+    * pcl::Median(), the median of an even number of samples is the mean of
+    * the two middle ones. Black pixels stay black and the fit is monotonic,
+    * so the bins of the middle samples are found by walking the histogram
+    * from black in the order of the fitted values. Unless the statistics are
+    * exact, the operand rows must then be fed to this sink once more, as they
+    * were to the statistics: the samples of the middle bins are gathered, and
+    * those of the middle ranks are selected among them.
+    */
+   class MedianRefinement : public WarpRowSink<P>
+   {
+   public:
+
+      MedianRefinement (const OperandStatistics& S, const LinearFitEngine::linear_fit_set& L) :
+      S (S), L (L), bin (size_type (2*S.channels)), rank (size_type (2*S.channels), size_type (0)), samples (size_type (2*S.channels))
+      {
+         for (int c = 0; c < S.channels; ++c)
+         {
+            size_type N = S.Count (c);
+            bin[2*c] = S.RankBin (c, Fit (c), (N > 0) ? (N - 1)/2 : 0, rank[2*c]);
+            bin[2*c+1] = S.RankBin (c, Fit (c), N/2, rank[2*c+1]);
+         }
+      }
+
+      virtual void Row (int y, const typename P::sample* const* row)
+      {
+         for (int i = 0; i < 2*S.channels; ++i)
+            if (bin[i] >= 0 && (i%2 == 0 || bin[i] != bin[i-1])) // a bin shared by both middle samples is gathered once
+            {
+               const typename P::sample* r = row[i/2];
+               double v[256];
+               int n = 0;
+               for (int x = 0; x < S.width; ++x)
+                  if (S.Bin (r[x]) == bin[i])
+                  {
+                     P::FromSample (v[n], r[x]);
+                     if (++n == 256)
+                        Add (i, v, n), n = 0;
+                  }
+               if (n > 0)
+                  Add (i, v, n);
+            }
+      }
+
+      double Median (int c)
+      {
+         return (Middle (2*c) + Middle (2*c+1))/2;
+      }
+
+   private:
+
+      const OperandStatistics& S;
+      const LinearFitEngine::linear_fit_set& L;
+      Array<int> bin; //bins of the two middle samples of each channel, -1 == black
+      Array<size_type> rank; //rank of each middle sample among the samples of its bin
+      Array<Array<double> > samples; //samples of the middle bins
+      Mutex mutex;
+
+      const LinearFit* Fit (int c) const
+      {
+         return (c < L.Length ()) ? &L[c] : 0;
+      }
+
+      // fitted value of the middle sample i
+      double Middle (int i)
+      {
+         if (bin[i] < 0)
+            return 0;
+         const LinearFit* F = Fit (i/2);
+         Array<double>& V = samples[(i%2 == 1 && bin[i] == bin[i-1]) ? i-1 : i];
+         if (rank[i] >= V.Length ())
+            return Fitted (double (bin[i])/(Bins - 1), F); // exact statistics
+         V.Sort ();
+         return Fitted (Descending (F) ? V[V.Length () - 1 - rank[i]] : V[rank[i]], F);
+      }
+
+      void Add (int i, const double* v, int n)
+      {
+         mutex.Lock ();
+         samples[i].Add (v, v + n);
+         mutex.Unlock ();
+      }
+   };
+
+private:
+
+   // histogram slot of a sample: its bin, or Bins for black samples
+   static int Bin (typename P::sample v)
+   {
+      double f;
+      P::FromSample (f, v);
+      return (f > 0) ? RoundInt (Min (f, 1.0)*(Bins - 1)) : int (Bins);
+   }
+
+   static bool Descending (const LinearFit* L)
+   {
+      return L != 0 && (*L)(1.0) < (*L)(0.0);
+   }
+
+   static double Fitted (double f, const LinearFit* L)
+   {
+      return (L != 0) ? Range ((*L)(f), 0.0, 1.0) : f;
+   }
+
+   // number of samples of channel c
+   size_type Count (int c) const
+   {
+      const size_type* h = Histogram (c);
+      size_type N = 0;
+      for (int k = 0; k <= Bins; ++k)
+         N += h[k];
+      return N;
+   }
+
+   /*
+    * Bin of the sample of rank R of channel c in the order of the fitted
+    * values, or -1 when that sample is black. In r, its rank among the
+    * samples of its bin in the same order. Only black samples, which stay
+    * black, come before the bins; dark samples of the bin 0 are fitted.
+    */
+   int RankBin (int c, const LinearFit* L, size_type R, size_type& r) const
+   {
+      const size_type* h = Histogram (c);
+      size_type n = h[Bins];
+      if (n > R)
+         return -1;
+      bool descending = Descending (L);
+      for (int i = 0; i < Bins; ++i)
+      {
+         int k = descending ? Bins - 1 - i : i;
+         if (n + h[k] > R)
+         {
+            r = R - n;
+            return k;
+         }
+         n += h[k];
+      }
+      return -1;
+   }
+
+   // histogram of channel c, the sum of the per-thread histograms
+   const size_type* Histogram (int c) const
    {
-      for (int c = 0; c < image.NumberOfNominalChannels (); ++c)
+      if (H.IsEmpty ())
+      {
+         H = Array<size_type> (size_type (channels)*(Bins + 1), size_type (0));
+         for (size_type i = 0; i < histograms.Length (); ++i)
+            for (size_type j = 0; j < H.Length (); ++j)
+               H[j] += (*histograms[i])[j];
+      }
+      return H.Begin () + size_type (c)*(Bins + 1);
+   }
+
+   // a histogram set no other thread is filling, created on demand
+   Array<size_type>* AcquireHistogram ()
+   {
+      Array<size_type>* h;
+      mutex.Lock ();
+      if (idle.IsEmpty ())
+      {
+         h = new Array<size_type> (size_type (channels)*(Bins + 1), size_type (0));
+         histograms.Add (h);
+      }
+      else
+      {
+         h = idle[idle.Length () - 1];
+         idle.Remove (idle.End () - 1);
+      }
+      mutex.Unlock ();
+      return h;
+   }
+
+   void ReleaseHistogram (Array<size_type>* h)
+   {
+      mutex.Lock ();
+      idle.Add (h);
+      mutex.Unlock ();
+   }
+
+   const GenericImage<Q>& target;
+   const LinearFitEngine* fit;
+   int channels;
+   int width;
+   FitSampling grid; //pixels gathered for the fit
+   IndirectArray<LinearFitEngine::SamplePairs> pairs; //fit pairs, by channel
+   Array<int> rowStart; //subsampled grid: the cells sampled in the row y are [rowStart[y],rowStart[y+1])
+   Array<int> rowColumns; //pixel column of each sampled cell
+   Array<int> rowCells; //cell column of each sampled cell
+   Array<int> cellRow; //cell row of each pixel row
+   bool histogram; //true == gather the operand histograms for the median
+   IndirectArray<Array<size_type> > histograms; //per-thread operand histograms, all channels, the black samples last
+   IndirectArray<Array<size_type> > idle; //histograms not being filled
+   mutable Array<size_type> H; //sum of the per-thread histograms
+   Mutex mutex;
+
+   void Gather (LinearFitEngine::SamplePairs& d, int row, int column, typename P::sample v1, typename Q::sample v2) const
+   {
+      float a;
+      P::FromSample (a, v1);
+      if (fit->Accepts (a))
       {
-         typename P::sample* v = image.PixelData (c);
-         typename P::sample* vN = v + image.NumberOfPixels ();
-         for (; v < vN; ++v)
+         float b;
+         Q::FromSample (b, v2);
+         if (fit->Accepts (b))
+            d.Set (row, column, a, b);
+      }
+   }
+};
+
+template <class P, class Q>
+class OperandSubtraction : public WarpRowSink<P>
+{
+public:
+
+   OperandSubtraction (const GenericImage<P>& operand, GenericImage<Q>& target, const LinearFitEngine::linear_fit_set& L, const DVector& median) :
+   target (target), L (L), median (median),
+   nominal (operand.NumberOfNominalChannels ()),
+   channels (Min (operand.NumberOfChannels (), target.NumberOfChannels ())),
+   width (target.Width ())
+   {
+   }
 
+   virtual void Row (int y, const typename P::sample* const* row)
+   {
+      for (int c = 0; c < channels; ++c)
+      {
+         const bool fit = c < nominal && c < L.Length ();
+         const double m = (c < nominal && c < median.Length ()) ? median[c] : 0.0;
+         const typename P::sample* v1 = row[c];
+         typename Q::sample* v2 = target.PixelData (c) + size_type (y)*target.Width ();
+         for (int x = 0; x < width; ++x)
          {
             double f;
-            if (*v > 0) //ignore black pixels
-
-            {
-               P::FromSample (f, *v);
-               *v = P::ToSample (L[c](f));
-            }
+            P::FromSample (f, v1[x]);
+            double g = fit ? Range (L[c](f), 0.0, 1.0) : f;
+            g = (g > 0) ? g - m : g;
+            f = (f > 0) ? g : f; //ignore black pixels
+            double t;
+            Q::FromSample (t, v2[x]);
+            v2[x] = Q::ToSample (Range (t - f, 0.0, 1.0));
          }
       }
+   }
+
+private:
 
-      image.Truncate ();
+   GenericImage<Q>& target;
+   const LinearFitEngine::linear_fit_set& L;
+   const DVector& median;
+   int nominal;
+   int channels;
+   int width;
+};
+
+/*
+ * Feeds the rows of an image to a row sink on the intra-frame threads, as
+ * WarpEngine::Stream() feeds the rows of a warped image.
+ */
+template <class P>
+class ImageRowsTask : public WarpBandTask
+{
+public:
+
+   ImageRowsTask (const GenericImage<P>& image, WarpRowSink<P>& sink, WarpMonitor* monitor) :
+   WarpBandTask (monitor), image (image), sink (sink)
+   {
+   }
+
+   virtual void Run (int y0, int y1)
+   {
+      Array<const typename P::sample*> row (size_type (image.NumberOfChannels ()));
+      for (int y = y0; y < y1; ++y)
+      {
+         for (int c = 0; c < image.NumberOfChannels (); ++c)
+            row[c] = image.PixelData (c) + size_type (y)*image.Width ();
+         sink.Row (y, row.Begin ());
+         if (!RowDone (y))
+            return;
+      }
    }
+
+private:
+
+   const GenericImage<P>& image;
+   WarpRowSink<P>& sink;
 };
 
 // ----------------------------------------------------------------------------
@@ -587,7 +1650,7 @@ private:
 };
 // ----------------------------------------------------------------------------
 
-class CAThread : public Thread
+class CAThread : public Thread, public WarpMonitor
 {
 public:
 
@@ -595,28 +1658,44 @@ public:
 	int monitor2;
 
    CAThread (ImageVariant* t, FileData* fd, ImageVariant* drzI, FileData* drzD, const String& tp, const String& dp, const DPoint d, const Matrix m, const CometAlignmentInstance* _instance) :
-   target (t), fileData (fd), drzImage(drzI), drzData(drzD), targetPath (tp), drzPath (dp), delta (d), drzMatrix(m), operand (_instance->m_OperandImage)
+   target (t), fileData (fd), drzImage(drzI), drzData(drzD), targetPath (tp), drzPath (dp), delta (d), drzMatrix(m), operand (_instance->m_OperandImage),
+   saImg (0), caImg (0)
    {
 	   drizzle = !drzMatrix.IsEmpty();
 	   monitor = "Prepare";
 	   monitor2 = 0;
 	   i = _instance;
+	   if (i->p_useROI) //clip the region of interest to the frame
+	   {
+		   roi = i->p_roi.Ordered ().Intersection (target->AnyImage ()->Bounds ());
+		   if (!roi.IsRect ())
+			   throw Error ("The region of interest is outside of the image: " + tp);
+	   }
+	   else
+		   roi = target->AnyImage ()->Bounds ();
+	   binning = Range (int (i->p_binning), 1, 4);
+	   if (roi.Width () < binning || roi.Height () < binning)
+		   throw Error ("The output image is smaller than the binning factor: " + tp);
+	   //whole binned pixels only: the ROI remainder is dropped here, so the output geometry, WCS and .drz matrices all agree
+	   roi.x1 = roi.x0 + roi.Width ()/binning*binning;
+	   roi.y1 = roi.y0 + roi.Height ()/binning*binning;
    }
 
    virtual
    ~CAThread ()
    {
-      if (target != 0)
-         delete target, target = 0;
+      i->m_pool->Release (target), target = 0; // image buffers go back to the pool for the next frames
 
       if (fileData != 0)
          delete fileData, fileData = 0;
 
-	  if (drzImage != 0)
-         delete drzImage, drzImage = 0;
+      i->m_pool->Release (drzImage), drzImage = 0;
 
 	  if (drzData != 0)
          delete drzData, drzData = 0;
+
+      i->m_pool->Release (saImg), saImg = 0;
+      i->m_pool->Release (caImg), caImg = 0;
    }
 
    virtual void
@@ -632,16 +1711,13 @@ public:
 		  if(!operand) 
 		  {
 			  monitor = "Align Target";
-			  HomographyApplyTo(*target, dM); //comet movement matrix
+			  if (!ApplyToROI(target, dM)) //comet movement matrix
+				  return;
 		  }
 		  else
 		  {	
-			  ImageVariant o;
-			  o.CopyImage (*operand); //Create local copy of Operand image
-
 			  if (i->p_subtractMode) //move Operand(ComaIntegration) and subtract -> create PureStarAligned
 			  {
-				  monitor = "Align Operand";
 				  Matrix M(dM);
 				  if(i->p_OperandIsDI) //Operand is DrizzleIntegration
 				  {
@@ -650,43 +1726,65 @@ public:
 					  M /= M[2][2];
 				  }
 				  M.Invert(); //Invert alignments direction
-				  HomographyApplyTo(o, M); //Invert delta to align Operand(CometIntegration) to comet position
-				  if (i->p_enableLinearFit)
+				  if (i->p_useROI || binning > 1)
 				  {
-					  LinearFitEngine E (i->p_rejectLow, i->p_rejectHigh);
-					  LFSet = E.Fit (monitor, o, *target);
-					  E.Apply (o, monitor, LFSet); //LinearFit Operand to Target
+					  monitor = "Crop Target";
+					  if (!ApplyToROI(target, Matrix::UnitMatrix (3))) //the target is star aligned: crop and bin it, then subtract only inside the ROI
+						  return;
+					  M = M * ROIMatrix ();
 				  }
-				  Normalize (o);				  
-				  (*target) -= o; //Subtract Operand(CometIntegration) from StarAligned and create PureStarAligned
+				  if (!SubtractWarped (*target, *operand, M, binning)) //Invert delta to align Operand(CometIntegration) to comet position and subtract it from StarAligned -> PureStarAligned
+					  return;
 			  }	
 			  else //subtract Operand(StarIntegration) and move to comet position -> create PureCometAligned 
 			  {
-				  if(i->p_OperandIsDI) //Operand is DrizzleIntegration
-				  { 
-					  monitor = "Align DI->SI";
-					  //convert Operand DrizzleIntegration coordinates to StarAlignment coordinates.
-					  HomographyApplyTo(o, cM.Inverse());
+				  ImageVariant* o = 0; //pooled buffer for the Operand in StarAlignment coordinates, DrizzleIntegration only
+				  bool subtracted = false;
+				  try
+				  {
+					  const ImageVariant* op = operand; //the Operand is read in place
+					  if(i->p_OperandIsDI) //Operand is DrizzleIntegration
+					  { 
+						  monitor = "Align DI->SI";
+						  //convert Operand DrizzleIntegration coordinates to StarAlignment coordinates
+						  o = i->m_pool->Acquire (*operand);
+						  if (Warp(*o, *operand, cM.Inverse()))
+							  op = o;
+						  else
+							  op = 0; //aborted
+					  }
+
+					  if (op != 0)
+					  {
+						  if (i->p_enableLinearFit)
+						  {
+							  LinearFitEngine E (i->p_rejectLow, i->p_rejectHigh, i->p_linearFitSamples, WarpThreads ());
+							  LFSet = E.Fit (monitor,*op, *target);
+							  LFError = E.Errors ();
+						  }
+						  subtracted = SubtractOperand (*target, *op); //LinearFit, normalize and subtract Operand from Target Image in one pass
+					  }
 				  }
-				  if (i->p_enableLinearFit)
+				  catch (...)
 				  {
-					  LinearFitEngine E (i->p_rejectLow, i->p_rejectHigh);
-					  LFSet = E.Fit (monitor,o, *target);
-					  E.Apply (o,monitor, LFSet); //LinearFit Operand to Target
+					  if (o != 0)
+						  i->m_pool->Release (o);
+					  throw;
 				  }
-				  Normalize (o);					  
-				  (*target) -= o; //Subtract Operand from Target Image
+				  if (o != 0)
+					  i->m_pool->Release (o); //free for the warp below
+				  if (!subtracted || TryIsAborted())
+					  return;
 				  monitor = "Align Target";
-				  HomographyApplyTo(*target, dM); //align Result to comet position
+				  if (!ApplyToROI(target, dM)) //align Result to comet position
+					  return;
+				  (*target).Truncate (); // Truncate to [0,1]
 			  }
-			  (*target).Truncate (); // Truncate to [0,1]
 
 			  if (TryIsAborted()) return;
 
 			  if(drizzle)// Create from NonAligned new PureStarNonAligned or PureComaNonAligned Image. 
 			  {
-				  o.CopyImage (*operand); //Create local copy of Operand image
-				  
 				  Matrix M(drzMatrix); 
 				  if (i->p_subtractMode) //Mode Checked -> Operand is ComaIntegration 
 				  {
@@ -705,45 +1803,15 @@ public:
 				  }
 
 				  M.Invert(); //Invert alignments direction
-				  monitor = "Align Operand";
-				  HomographyApplyTo(o, M); //Align Operand to Origin drizle integrable 
-				  
-				  if (TryIsAborted()) return;
-				  
-				  if (i->p_enableLinearFit)
-				  {
-					  LinearFitEngine E(i->p_rejectLow, i->p_rejectHigh);
-					  LFSet = E.Fit (monitor, o, *drzImage);
-					  E.Apply (o, monitor, LFSet); //LinearFit Operand to Target
-				  }
-				  if (TryIsAborted()) return;
-				  
-				  Normalize (o);
-				  
-				  (*drzImage) -= o; //Subtract Operand from Target Image
-				  (*drzImage).Truncate(); // Truncate to [0,1]
-				  /*
-				  if (TryIsAborted()) return;
-				  
-				  if(i->p_drzSaveSA) //Optional: create from PureNonAligned the PureStarAligned
-				  {
-					  saImg.CopyImage(*drzImage);
-					  M = drzMatrix; // use star alignment matrix
-					  monitor = "Align PureStar";
-					  HomographyApplyTo(saImg, M);
-				  }
+				  if (!SubtractWarped (*drzImage, *operand, M, 1) || TryIsAborted()) //Align Operand to Origin drizle integrable and subtract it
+					  return;
 
-				  if (TryIsAborted()) return;	
-				  
-				  if(i->p_drzSaveCA) //Optional: create from PureNonAligned the PureCometAligned
+				  if(i->p_drzSaveSA || i->p_drzSaveCA) //Optional: create from PureNonAligned the PureStarAligned and PureCometAligned
 				  {
-					  monitor = "Align PureComet";
-					  caImg.CopyImage(*drzImage);
-					  M = drzMatrix*DeltaToMatrix(delta); // integrate star alignment matrix and comet movement matrix
-					  M /= M[2][2];
-					  HomographyApplyTo(caImg, M); 
+					  monitor = "Align PureStar/Comet";
+					  if (!AlignDrizzleImage ())
+						  return;
 				  }
-				  */
 			  }
 		  }
       }
@@ -758,6 +1826,30 @@ public:
       }
    }
 
+   Rect ROI () const // region of the output frame generated in the target image
+   {
+      return roi;
+   }
+
+   Matrix ROIMatrix () const // maps unbinned target image coordinates to output frame coordinates
+   {
+      return DeltaToMatrix (DPoint (roi.x0, roi.y0));
+   }
+
+   int Binning () const
+   {
+      return binning;
+   }
+
+   Matrix BinningMatrix () const // maps binned target image coordinates to unbinned ones, at pixel centers
+   {
+      double o = (binning - 1)/2.0;
+      return Matrix (
+         double (binning), 0.0, o,
+         0.0, double (binning), o,
+         0.0, 0.0, 1.0);
+   }
+
    const ImageVariant* TargetImage () const
    {
       return target;
@@ -813,17 +1905,28 @@ public:
       return drzMatrix;
    }
       
+   virtual bool RowDone( int y )
+   {
+      monitor2 = y;
+      return !TryIsAborted();
+   }
+
    LinearFitEngine::linear_fit_set GetLinearFitSet() const
    {
       return LFSet;
    }
 
-   const ImageVariant StarAligned() const
+   LinearFitEngine::fit_error_set GetLinearFitError() const
+   {
+      return LFError;
+   }
+
+   const ImageVariant* StarAligned() const
    {
       return saImg;
    }
      
-   const ImageVariant CometAligned() const
+   const ImageVariant* CometAligned() const
    {
       return caImg;
    }
@@ -841,110 +1944,344 @@ private:
 	Matrix drzMatrix; //drizzle AlignmentMatrix
 	const ImageVariant* operand; //Image for subtraction from target
 	LinearFitEngine::linear_fit_set LFSet;
-	ImageVariant saImg; //pureStarAligned
-	ImageVariant caImg; //pureCometAligned
+	LinearFitEngine::fit_error_set LFError; //standard errors of the LFSet coefficients
+	ImageVariant* saImg; //pureStarAligned, pooled
+	ImageVariant* caImg; //pureCometAligned, pooled
+	Rect roi; // region of interest in output frame coordinates, the whole frame if not used
+	int binning; // output pixels per side of a binned target pixel
 	
    
-   template <class P>
-   void Normalize (GenericImage<P>& img) //subtract Median from Comet image
-   {
-	   for (int c = 0; c < img.NumberOfNominalChannels (); ++c)
+   /*
+    * Subtracts the operand from the image, both with the same geometry, with
+    * the optional LinearFit LFSet and normalization, in a single parallel
+    * pass through OperandSubtraction that reads each sample once. The median
+    * of the normalization comes from the operand histogram gathered by
+    * OperandStatistics in a first pass over the operand alone, refined by a
+    * second one when the histogram bins can hold several sample values.
+    * Returns false if the task was aborted.
+    */
+   template <class P, class Q>
+   bool SubtractOperand (GenericImage<Q>& image, const GenericImage<P>& op)
+   {
+	   if (op.Width () != image.Width () || op.Height () != image.Height ())
+		   throw Error ("Incompatible operand image geometry: " + targetPath);
+	   DVector median;
+	   if (i->p_normalize)
 	   {
-		   typename P::sample m = img.Median (0, c, c);
-		   typename P::sample* v = img.PixelData (c);
-		   typename P::sample* vN = v + img.NumberOfPixels ();
-		   for (; v < vN; ++v)
-			   if (*v > 0) //ignore black pixels
-				   *v -= m;
+		   monitor = "Normalization";
+		   OperandStatistics<P, Q> S (op, image, 0, true);
+		   ImageRowsTask<P> task (op, S, this);
+		   if (!RunWarpBands (task, op.Height (), WarpThreads ()))
+			   return false;
+		   typename OperandStatistics<P, Q>::MedianRefinement R (S, LFSet);
+		   if (!S.IsExact ())
+		   {
+			   ImageRowsTask<P> refine (op, R, this);
+			   if (!RunWarpBands (refine, op.Height (), WarpThreads ()))
+				   return false;
+		   }
+		   median = DVector (0.0, S.NumberOfChannels ());
+		   for (int c = 0; c < median.Length (); ++c)
+			   median[c] = R.Median (c);
 	   }
+	   monitor = "Subtract Operand";
+	   OperandSubtraction<P, Q> D (op, image, LFSet, median);
+	   ImageRowsTask<P> task (op, D, this);
+	   return RunWarpBands (task, op.Height (), WarpThreads ());
    }
-   
-   void Normalize (ImageVariant& cimg)
+
+   template <class P>
+   bool SubtractOperand (ImageVariant& image, const GenericImage<P>& op)
    {
-	   monitor = "Normalization";
-	   if (!i->p_normalize || cimg.IsComplexSample() )
-		   return;
-	   #if debug
-	   Console().Write("Normalize ");
-	   #endif
-	   if (cimg.IsFloatSample ())
-		   switch (cimg.BitsPerSample ())
-	   {
-		   case 32: Normalize (static_cast<Image&> (*cimg)); break;
-		   case 64: Normalize (static_cast<DImage&> (*cimg)); break;
-	   }
-	   else 
-		   switch (cimg.BitsPerSample ())
+      if (image.IsFloatSample ())
+         switch (image.BitsPerSample ())
+         {
+         case 32: return SubtractOperand (static_cast<Image&> (*image), op);
+         case 64: return SubtractOperand (static_cast<DImage&> (*image), op);
+         }
+      else
+         switch (image.BitsPerSample ())
+         {
+         case 8: return SubtractOperand (static_cast<UInt8Image&> (*image), op);
+         case 16: return SubtractOperand (static_cast<UInt16Image&> (*image), op);
+         case 32: return SubtractOperand (static_cast<UInt32Image&> (*image), op);
+         }
+      return true;
+   }
+
+   bool SubtractOperand (ImageVariant& image, const ImageVariant& op)
+   {
+      if (image.IsComplexSample () || op.IsComplexSample ())
+         return true;
+      if (op.IsFloatSample ())
+         switch (op.BitsPerSample ())
+         {
+         case 32: return SubtractOperand (image, static_cast<const Image&> (*op));
+         case 64: return SubtractOperand (image, static_cast<const DImage&> (*op));
+         }
+      else
+         switch (op.BitsPerSample ())
+         {
+         case 8: return SubtractOperand (image, static_cast<const UInt8Image&> (*op));
+         case 16: return SubtractOperand (image, static_cast<const UInt16Image&> (*op));
+         case 32: return SubtractOperand (image, static_cast<const UInt32Image&> (*op));
+         }
+      return true;
+   }
+
+   /*
+    * Warps the operand with M and subtracts it from the image, with the
+    * optional LinearFit and normalization, streaming the warped operand rows
+    * through OperandStatistics and OperandSubtraction. With bin > 1 the
+    * image is binned and the operand is streamed binned by bin x bin pixels,
+    * M mapping unbinned coordinates. Returns false if the task was aborted.
+    */
+   template <class P, class Q>
+   bool SubtractWarped (GenericImage<Q>& image, const GenericImage<P>& op, const Matrix& M, int bin)
+   {
+	   LinearFitEngine E (i->p_rejectLow, i->p_rejectHigh, i->p_linearFitSamples, WarpThreads ());
+	   LFSet = LinearFitEngine::linear_fit_set ();
+	   LFError = LinearFitEngine::fit_error_set ();
+	   DVector median;
+	   if (i->p_enableLinearFit || i->p_normalize)
 	   {
-		   case 8: Normalize (static_cast<UInt8Image&> (*cimg)); break;
-		   case 16: Normalize (static_cast<UInt16Image&> (*cimg)); break;
-		   case 32: Normalize (static_cast<UInt32Image&> (*cimg)); break;
+		   monitor = "Operand Statistics";
+		   OperandStatistics<P, Q> S (op, image, i->p_enableLinearFit ? &E : 0, i->p_normalize);
+		   if (!i->m_warp->StreamBinned (op, M, S, image.Width (), image.Height (), bin, this, WarpThreads ()))
+			   return false;
+		   if (i->p_enableLinearFit)
+		   {
+			   monitor = "LFit calc";
+			   LFSet = S.Fit (LFError);
+		   }
+		   if (i->p_normalize)
+		   {
+			   typename OperandStatistics<P, Q>::MedianRefinement R (S, LFSet);
+			   if (!S.IsExact ())
+			   {
+				   monitor = "Normalization";
+				   if (!i->m_warp->StreamBinned (op, M, R, image.Width (), image.Height (), bin, this, WarpThreads ()))
+					   return false;
+			   }
+			   median = DVector (0.0, S.NumberOfChannels ());
+			   for (int c = 0; c < median.Length (); ++c)
+				   median[c] = R.Median (c);
+		   }
 	   }
+	   monitor = "Subtract Operand";
+	   OperandSubtraction<P, Q> D (op, image, LFSet, median);
+	   return i->m_warp->StreamBinned (op, M, D, image.Width (), image.Height (), bin, this, WarpThreads ());
+   }
+
+   template <class P>
+   bool SubtractWarped (ImageVariant& image, const GenericImage<P>& op, const Matrix& M, int bin)
+   {
+      if (image.IsFloatSample ())
+         switch (image.BitsPerSample ())
+         {
+         case 32: return SubtractWarped (static_cast<Image&> (*image), op, M, bin);
+         case 64: return SubtractWarped (static_cast<DImage&> (*image), op, M, bin);
+         }
+      else
+         switch (image.BitsPerSample ())
+         {
+         case 8: return SubtractWarped (static_cast<UInt8Image&> (*image), op, M, bin);
+         case 16: return SubtractWarped (static_cast<UInt16Image&> (*image), op, M, bin);
+         case 32: return SubtractWarped (static_cast<UInt32Image&> (*image), op, M, bin);
+         }
+      return true;
+   }
+
+   bool SubtractWarped (ImageVariant& image, const ImageVariant& op, const Matrix& M, int bin)
+   {
+      if (image.IsComplexSample () || op.IsComplexSample ())
+         return true;
+      if (op.IsFloatSample ())
+         switch (op.BitsPerSample ())
+         {
+         case 32: return SubtractWarped (image, static_cast<const Image&> (*op), M, bin);
+         case 64: return SubtractWarped (image, static_cast<const DImage&> (*op), M, bin);
+         }
+      else
+         switch (op.BitsPerSample ())
+         {
+         case 8: return SubtractWarped (image, static_cast<const UInt8Image&> (*op), M, bin);
+         case 16: return SubtractWarped (image, static_cast<const UInt16Image&> (*op), M, bin);
+         case 32: return SubtractWarped (image, static_cast<const UInt32Image&> (*op), M, bin);
+         }
+      return true;
+   }
+
+   int WarpThreads () const // intra-frame threads: current share of the CPUs among the frames in flight
+   {
+	   return i->m_threads->Share ();
    }
 
    template <class P>
-   void HomographyApplyTo (GenericImage<P>& input, const Matrix M)
+   bool HomographyApplyTo (GenericImage<P>& input, const Matrix M)
 	{
-		Homography H(M);
-		int wi = input.Width();
-		int hi = input.Height();
-		int n = input.NumberOfNominalChannels();
-		int n1 = input.NumberOfChannels();		
-			
-		GenericImage<P> output;			
-		output.AllocateData(wi, hi, n1, input.ColorSpace());     
-			
-		IndirectArray<PixelInterpolation::Interpolator<P> > interpolators( n1 );
-		for ( int c = 0; c < n1; ++c )
-		{
-			int c0 = (c < n) ? Min( c, n-1 ) : Min( c-n, n1-n-1 ) + n;
-			interpolators[c] = pixelInterpolation->NewInterpolator( (P*)0, input.PixelData( c0 ), wi, hi );
-		}
-		
-		for ( int y = 0; y < hi; ++y)
-		{
-			for ( int x = 0; x < wi; ++x )
-			{
-				DPoint p = H(x,y); //caclulate source point via Homography
-				if ( p.x >= 0 && p.x < wi && p.y >= 0 && p.y < hi ) // ignore out of bounds points
-				{
-					for ( int c = 0; c < n1; ++c )
-					{
-						output.Pixel(x,y,c) = (*interpolators[c])( p );
-					}
-				}
-			}
-			if ( TryIsAborted() )
-				return;
-			monitor2 = y;
-		}
-		interpolators.Destroy();
-		input.Assign(output);
+		return i->m_warp->Apply( input, M, this, WarpThreads() );
 	}
+
+   /*
+    * Applies M to the image, with ping-pong buffers: the image is warped into
+    * a pooled buffer of the same geometry, which then takes its place, and
+    * the former image goes back to the pool. Whole-pixel shifts are applied
+    * in place. Returns false if the warp has been aborted, in which case the
+    * image has not been transformed.
+    */
+   bool HomographyApplyTo (ImageVariant*& image, const Matrix& M)
+   {
+      if (image->IsComplexSample ())
+         return true;
+      if (i->m_warp->IsWholePixelShift (M))
+         return HomographyApplyTo (*image, M);
+      ImageVariant* output = i->m_pool->Acquire (*image);
+      bool done;
+      try
+      {
+         done = Warp (*output, *image, M);
+         if (done)
+            Swap (image, output);
+      }
+      catch (...)
+      {
+         i->m_pool->Release (output);
+         throw;
+      }
+      i->m_pool->Release (output);
+      return done;
+   }
+
+   /*
+    * Applies M to the image as HomographyApplyTo() does, but when the
+    * instance defines a region of interest, only the ROI of the output is
+    * generated, binned if requested, into a pooled buffer of its size that
+    * then takes the place of the image. Returns false if the warp has been
+    * aborted.
+    */
+   bool ApplyToROI (ImageVariant*& image, const Matrix& M)
+   {
+      if (!i->p_useROI && binning == 1)
+         return HomographyApplyTo (image, M);
+      if (image->IsComplexSample ())
+         return true;
+      ImageVariant* output = i->m_pool->Acquire (image->IsFloatSample (), image->BitsPerSample (),
+                                                 roi.Width ()/binning, roi.Height ()/binning,
+                                                 image->NumberOfChannels (), image->ColorSpace ());
+      bool done;
+      try
+      {
+         Matrix R = M * ROIMatrix ();
+         R /= R[2][2];
+         done = Warp (*output, *image, R, binning);
+         if (done)
+            Swap (image, output);
+      }
+      catch (...)
+      {
+         i->m_pool->Release (output);
+         throw;
+      }
+      i->m_pool->Release (output);
+      return done;
+   }
+
+   /*
+    * Generates the pure star aligned and/or comet aligned images from the
+    * pure non-aligned drzImage, in one sweep of the multi-output warp. Both
+    * have the geometry of the target image, its ROI included. Returns false
+    * if the warp has been aborted.
+    */
+   template <class P>
+   bool AlignDrizzleImage (const GenericImage<P>& image)
+   {
+      Array<GenericImage<P>*> outputs;
+      Array<Matrix> M;
+      if (i->p_drzSaveSA)
+      {
+         outputs.Add (static_cast<GenericImage<P>*> (saImg->AnyImage ()));
+         M.Add (drzMatrix * ROIMatrix ()); // star alignment matrix
+      }
+      if (i->p_drzSaveCA)
+      {
+         outputs.Add (static_cast<GenericImage<P>*> (caImg->AnyImage ()));
+         M.Add (drzMatrix * DeltaToMatrix (delta) * ROIMatrix ()); // integrate star alignment matrix and comet movement matrix
+      }
+      for (size_type k = 0; k < M.Length (); ++k)
+         M[k] /= M[k][2][2];
+      return i->m_warp->Warp (outputs, image, M, this, WarpThreads ());
+   }
+
+   bool AlignDrizzleImage ()
+   {
+      if (drzImage->IsComplexSample ())
+         return true;
+      if (i->p_drzSaveSA)
+         saImg = i->m_pool->Acquire (drzImage->IsFloatSample (), drzImage->BitsPerSample (),
+                                     roi.Width (), roi.Height (), drzImage->NumberOfChannels (), drzImage->ColorSpace ());
+      if (i->p_drzSaveCA)
+         caImg = i->m_pool->Acquire (drzImage->IsFloatSample (), drzImage->BitsPerSample (),
+                                     roi.Width (), roi.Height (), drzImage->NumberOfChannels (), drzImage->ColorSpace ());
+      if (drzImage->IsFloatSample ())
+         switch (drzImage->BitsPerSample ())
+         {
+         case 32: return AlignDrizzleImage (static_cast<const Image&> (**drzImage));
+         case 64: return AlignDrizzleImage (static_cast<const DImage&> (**drzImage));
+         }
+      else
+         switch (drzImage->BitsPerSample ())
+         {
+         case 8: return AlignDrizzleImage (static_cast<const UInt8Image&> (**drzImage));
+         case 16: return AlignDrizzleImage (static_cast<const UInt16Image&> (**drzImage));
+         case 32: return AlignDrizzleImage (static_cast<const UInt32Image&> (**drzImage));
+         }
+      return true;
+   }
+
+   template <class P>
+   bool Warp (GenericImage<P>& output, const GenericImage<P>& image, const Matrix& M, int bin)
+   {
+      return i->m_warp->WarpBinned (output, image, M, bin, this, WarpThreads ());
+   }
+
+   bool Warp (ImageVariant& output, const ImageVariant& image, const Matrix& M, int bin = 1) // output and image have the same sample type
+   {
+      if (image.IsFloatSample ())
+         switch (image.BitsPerSample ())
+         {
+         case 32: return Warp (static_cast<Image&> (*output), static_cast<const Image&> (*image), M, bin);
+         case 64: return Warp (static_cast<DImage&> (*output), static_cast<const DImage&> (*image), M, bin);
+         }
+      else
+         switch (image.BitsPerSample ())
+         {
+         case 8: return Warp (static_cast<UInt8Image&> (*output), static_cast<const UInt8Image&> (*image), M, bin);
+         case 16: return Warp (static_cast<UInt16Image&> (*output), static_cast<const UInt16Image&> (*image), M, bin);
+         case 32: return Warp (static_cast<UInt32Image&> (*output), static_cast<const UInt32Image&> (*image), M, bin);
+         }
+      return false;
+   }
  
-   void HomographyApplyTo(ImageVariant& image, const Matrix M )
+   bool HomographyApplyTo(ImageVariant& image, const Matrix M )
 	{
 		if (!image.IsComplexSample ())
 		{
       if (image.IsFloatSample ())
          switch (image.BitsPerSample ())
          {
-         case 32: HomographyApplyTo (static_cast<Image&> (*image),M);
-            break;
-         case 64: HomographyApplyTo (static_cast<DImage&> (*image),M);
-            break;
+         case 32: return HomographyApplyTo (static_cast<Image&> (*image),M);
+         case 64: return HomographyApplyTo (static_cast<DImage&> (*image),M);
          }
       else
          switch (image.BitsPerSample ())
          {
-         case 8: HomographyApplyTo (static_cast<UInt8Image&> (*image),M);
-            break;
-         case 16: HomographyApplyTo (static_cast<UInt16Image&> (*image),M);
-            break;
-         case 32: HomographyApplyTo (static_cast<UInt32Image&> (*image),M);
-            break;
+         case 8: return HomographyApplyTo (static_cast<UInt8Image&> (*image),M);
+         case 16: return HomographyApplyTo (static_cast<UInt16Image&> (*image),M);
+         case 32: return HomographyApplyTo (static_cast<UInt32Image&> (*image),M);
          }		
 		}
+		return true;
 	}
 };
 
@@ -956,11 +2293,10 @@ static void LoadImageFile (GenericImage<P>& image, FileFormatInstance& file)
    if (!file.ReadImage (image))
       throw CatchedException ();
 }
-static void LoadImageFile (ImageVariant& v, FileFormatInstance& file, ImageOptions options)
+static void ReadImageFile (ImageVariant& v, FileFormatInstance& file) //read into the existing image v
 {
    if (!file.SelectImage (0))
       throw CatchedException ();
-	v.CreateSharedImage (options.ieeefpSampleFormat, false, options.bitsPerSample);
 
    if (v.IsFloatSample ()) switch (v.BitsPerSample ())
       {
@@ -980,7 +2316,29 @@ static void LoadImageFile (ImageVariant& v, FileFormatInstance& file, ImageOptio
       }
 	  
 }
-FileData* CometAlignmentInstance::CAReadImage(ImageVariant* img, const String& path)
+static void LoadImageFile (ImageVariant& v, FileFormatInstance& file, ImageOptions options)
+{
+	v.CreateSharedImage (options.ieeefpSampleFormat, false, options.bitsPerSample);
+	ReadImageFile (v, file);
+}
+/*
+ * Sample format of the images processed from a file with the options o. With
+ * float working precision, 64-bit float and 32-bit integer images are read,
+ * warped and subtracted as 32-bit float images. Output files keep the
+ * options of their source files, so they are converted back when written.
+ */
+inline ImageOptions CometAlignmentInstance::WorkingOptions (const ImageOptions& o) const
+{
+	ImageOptions w (o);
+	if (p_floatWorkingPrecision && (o.bitsPerSample == 64 || (o.bitsPerSample == 32 && !o.ieeefpSampleFormat)))
+	{
+		w.bitsPerSample = 32;
+		w.ieeefpSampleFormat = true;
+	}
+	return w;
+}
+
+FileData* CometAlignmentInstance::CAReadImage(ImageVariant*& img, const String& path)
 {
 	FileFormat format (File::ExtractExtension (path), true, false);
 	FileFormatInstance file (format);
@@ -988,7 +2346,12 @@ FileData* CometAlignmentInstance::CAReadImage(ImageVariant* img, const String& p
 	if ( !file.Open( images, path, p_inputHints ) ) throw CatchedException ();
 	if (images.IsEmpty ()) throw Error (path + ": Empty image file.");
 	if (images.Length () > 1) throw Error ("Multiple image files is not supported.");
-	LoadImageFile (*img, file, images[0].options);
+	//read into a pooled buffer; the caller releases img, also if this throws.
+	const ImageInfo& info = images[0].info;
+	const ImageOptions working = WorkingOptions (images[0].options);
+	img = m_pool->Acquire (working.ieeefpSampleFormat, working.bitsPerSample,
+	                       info.width, info.height, info.numberOfChannels, info.colorSpace);
+	ReadImageFile (*img, file);
 	//ImageVariant2ImageWindow(img); //show loaded image
 	ProcessInterface::ProcessEvents ();
 	if (m_geometry.IsRect ())
@@ -1058,7 +2421,6 @@ inline thread_list CometAlignmentInstance::LoadTargetFrame (const size_t fileInd
 	try
 	{
 		//read target
-		targetImage = new ImageVariant();
 		targetPath = item.path;
 		targetData = CAReadImage(targetImage, targetPath);		
 
@@ -1077,7 +2439,6 @@ inline thread_list CometAlignmentInstance::LoadTargetFrame (const size_t fileInd
 
 			if(m_OperandImage)
 			{
-				drzImage = new ImageVariant();
 				drzData = CAReadImage(drzImage, drzSourcePath);
 			}
 		}
@@ -1088,9 +2449,9 @@ inline thread_list CometAlignmentInstance::LoadTargetFrame (const size_t fileInd
    }
    catch (...)
    {
-      if (targetImage != 0) delete targetImage;
+      m_pool->Release (targetImage);
 	  if (targetData != 0) delete targetData;
-	  if (drzImage != 0) delete drzImage;
+	  m_pool->Release (drzImage);
 	  if (drzData != 0) delete drzData;
       throw;
    }
@@ -1181,7 +2542,7 @@ inline String CometAlignmentInstance::OutputImgPath (const String& imgPath, cons
    String fileName = File::ExtractName (imgPath);
    fileName.Trim ();
    if (!p_prefix.IsEmpty ()) fileName.Prepend (p_prefix);
-   if (!p_postfix.IsEmpty ()) fileName.Append (postfix);
+   if (!postfix.IsEmpty ()) fileName.Append (postfix);
    if (fileName.IsEmpty ()) throw Error (imgPath + ": Unable to determine an output file name.");
 
    String outputFilePath = dir + fileName + p_outputExtension;
@@ -1199,20 +2560,25 @@ inline String CometAlignmentInstance::OutputImgPath (const String& imgPath, cons
    return outputFilePath;
 }
 
-void LFReport(const LinearFitEngine::linear_fit_set L) 
+void LFReport(const LinearFitEngine::linear_fit_set L, const LinearFitEngine::fit_error_set E) 
 {
 	Console().WriteLn( "<end><cbr>Linear fit functions:" );
 	for ( int c = 0; c <  L.Length() ; ++c )
 	{
 		Console().WriteLn( String().Format( "y<sub>%d</sub> = %+.6f %c %.6f&middot;x<sub>%d</sub>", c, L[c].a, (L[c].b < 0) ? '-' : '+', Abs( L[c].b ), c ) );
 		Console().WriteLn( String().Format( "&sigma;<sub>%d</sub> = %+.6f", c, L[c].adev ) );
+		if ( c < E.Length() )
+			Console().WriteLn( String().Format( "&epsilon;a<sub>%d</sub> = %.6e &epsilon;b<sub>%d</sub> = %.6e", c, E[c].a, c, E[c].b ) );
 	}
 }
-void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const int8 mode)
+String CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const int8 mode)
 {
 	//mode ==
 	//0 == Save target result image
 	//1 == Save new NonAligned image
+	//2 == Save PureStarAligned image
+	//3 == Save PureCometAligned image
+	//returns the path of the written file
 
 	Console console;
 	String inputImgPath;
@@ -1228,7 +2594,7 @@ void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const in
 	else
 	{
 		data = t->GetDrzData();
-		postfix.Clear();
+		postfix = (mode == 2) ? "_sa" : ((mode == 3) ? "_ca" : "");
 		inputImgPath = t->DrizzlePath();			//drizzle source image path	
 		//data = t->GetDrzData();
 	}
@@ -1238,10 +2604,12 @@ void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const in
 	DPoint delta(t->Delta());						//comet movement delta
 
 	LinearFitEngine::linear_fit_set L;				//LinearFit result
+	LinearFitEngine::fit_error_set LE;				//LinearFit coefficient standard errors
 	if ( operand && p_enableLinearFit )
 	{
       L = t->GetLinearFitSet();
-	  LFReport(L);
+      LE = t->GetLinearFitError();
+	  LFReport(L, LE);
 	}	
 
 
@@ -1274,11 +2642,14 @@ void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const in
          keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.RejectHigh: " + IsoString( p_rejectHigh ) ) );
          if (p_enableLinearFit)
          {
+            keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.LinearFitSamples: " + (p_linearFitSamples ? IsoString( p_linearFitSamples ) : IsoString( "all" )) ) );
             keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.Linear fit functions:" ) );
             for ( int c = 0; c < L.Length(); ++c )
             {
                keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), IsoString().Format( "y%d = %+.6f %c %.6f * x%d", c, L[c].a, (L[c].b < 0) ? '-' : '+', Abs( L[c].b ), c ) ) );
                keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), IsoString().Format( "sigma%d = %+.6f", c, L[c].adev ) ) );
+               if ( c < LE.Length() )
+                  keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), IsoString().Format( "error%d = a:%.3e b:%.3e", c, LE[c].a, LE[c].b ) ) );
             }
          }
          keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.Normalize: " + IsoString( p_normalize ? "true" : "false") ) );
@@ -1287,6 +2658,37 @@ void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const in
 	  keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.X: " + IsoString(delta.x)));
       keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.Y:" +IsoString(delta.y)));
 
+      if (p_useROI && mode != 1) //the target and pure aligned images are crops of the output frame
+      {
+         Rect r = t->ROI ();
+         keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), IsoString ().Format ("CometAlignment.ROI: %d,%d,%d,%d", r.x0, r.y0, r.x1, r.y1)));
+         for (FITSKeywordArray::iterator k = keywords.Begin (); k != keywords.End (); ++k)
+         {
+            double v;
+            if ((k->name == "CRPIX1" || k->name == "CRPIX2") && k->value.TryToDouble (v))
+               k->value = IsoString ().Format ("%.10g", v - ((k->name == "CRPIX1") ? r.x0 : r.y0));
+         }
+      }
+
+      const int b = t->Binning ();
+      if (b > 1 && mode == 0) //the target image is binned: scale the pixel grid keywords
+      {
+         keywords.Add (FITSHeaderKeyword ("HISTORY", IsoString (), "CometAlignment.Binning: " + IsoString (b)));
+         for (FITSKeywordArray::iterator k = keywords.Begin (); k != keywords.End (); ++k)
+         {
+            double v;
+            if (!k->value.TryToDouble (v))
+               continue;
+            if (k->name == "CRPIX1" || k->name == "CRPIX2") // pixel centers: 1 -> (b+1)/(2b)
+               k->value = IsoString ().Format ("%.10g", (v - 0.5)/b + 0.5);
+            else if (k->name == "CDELT1" || k->name == "CDELT2" || k->name == "CD1_1" || k->name == "CD1_2" || k->name == "CD2_1" || k->name == "CD2_2"
+                     || k->name == "XPIXSZ" || k->name == "YPIXSZ")
+               k->value = IsoString ().Format ("%.10g", v*b);
+            else if (k->name == "XBINNING" || k->name == "YBINNING")
+               k->value = IsoString (RoundInt (v)*b);
+         }
+      }
+
       outputFile.Embed (keywords);
    }
    else if (!data->keywords.IsEmpty ())
@@ -1316,7 +2718,7 @@ void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const in
 			#endif
 			t->TargetPath(outputImgPath); 
 		}
-		else if( operand ) //operand && mode == 1
+		else if( operand && mode == 1 )
 		{	//we create new NonRegistered image -> store path to CAThread for re use in .drz file
 			#if debug
 			console.WriteLn ("Update DrizzlePath to: " +outputImgPath);
@@ -1324,6 +2726,7 @@ void CometAlignmentInstance::Save(const ImageVariant* img, CAThread* t, const in
 			t->DrizzlePath(outputImgPath); 
 		}
 	}
+	return outputImgPath;
 }
 void CometAlignmentInstance::SaveImage( CAThread* t)
 {	
@@ -1333,6 +2736,18 @@ void CometAlignmentInstance::SaveImage( CAThread* t)
 	
 	if (!t->DrizzlePath().IsEmpty())
 	{
+		//pure aligned images are named after the drizzle source image, so they are written before its path changes
+		String saPath, caPath;
+		if(t->StarAligned())					//Save PureStarAligned
+		{
+			Console().WriteLn ("Save PureStarAligned");
+			saPath = Save(t->StarAligned(), t, 2);
+		}
+		if(t->CometAligned())					//Save PureCometAligned
+		{
+			Console().WriteLn ("Save PureCometAligned");
+			caPath = Save(t->CometAligned(), t, 3);
+		}
 		if(t->DrizzleImage())					//Save new NonAligned image	
 		{
 			Console().WriteLn ("Save new NonAligned");
@@ -1345,24 +2760,28 @@ void CometAlignmentInstance::SaveImage( CAThread* t)
 			M = M * DeltaToMatrix(t->Delta()); // add comet movement delta
 			M /= M[2][2];
 		}
+		if (p_useROI || t->Binning() > 1)
+		{
+			M = M * t->ROIMatrix() * t->BinningMatrix(); // the target image is the binned ROI crop of the output frame
+			M /= M[2][2];
+		}
 	
 		Console().WriteLn ("Save .drz file");
 		SaveDrizzleFile( t->DrizzlePath(), t->TargetPath(), M, t->TargetImage()->Width(), t->TargetImage()->Height() );
+
+		if(!saPath.IsEmpty())
+		{
+			M = t->DrzMatrix() * t->ROIMatrix(); // starAlignment matrix
+			M /= M[2][2];
+			SaveDrizzleFile( t->DrizzlePath(), saPath, M, t->StarAligned()->Width(), t->StarAligned()->Height() );
+		}
+		if(!caPath.IsEmpty())
+		{
+			M = t->DrzMatrix() * DeltaToMatrix(t->Delta()) * t->ROIMatrix(); // starAlignment matrix and comet movement delta
+			M /= M[2][2];
+			SaveDrizzleFile( t->DrizzlePath(), caPath, M, t->CometAligned()->Width(), t->CometAligned()->Height() );
+		}
 	}
-	/*
-	if(t->StarAligned())					//Save PureStarAligned
-	{
-		ImageVariant* img = new ImageVariant(t->StarAligned());
-		Save(img, t, 2);
-		delete img, img = 0;
-	}
-	if(t->CometAligned())					//Save PureCometAligned
-	{
-		ImageVariant* img = new ImageVariant(t->StarAligned());
-		Save(img, t, 3);
-		delete img, img = 0;
-	}
-		*/
 }
 
 // ----------------------------------------------------------------------------
@@ -1372,55 +2791,9 @@ inline void CometAlignmentInstance::InitPixelInterpolation ()
    Console ().WriteLn ("PixelInterpolation: " + ThePixelInterpolationParameter->ElementId (p_pixelInterpolation));
    if (p_pixelInterpolation == CAPixelInterpolation::BicubicSpline) Console ().WriteLn ("ClampingThreshold : " + String (p_linearClampingThreshold));
 
-   switch (p_pixelInterpolation)
-   {
-   case CAPixelInterpolation::NearestNeighbor:
-      pixelInterpolation = new NearestNeighborPixelInterpolation;
-      break;
-   case CAPixelInterpolation::Bilinear:
-      pixelInterpolation = new BilinearPixelInterpolation;
-      break;
-   default:
-   case CAPixelInterpolation::BicubicSpline:
-      pixelInterpolation = new BicubicSplinePixelInterpolation (p_linearClampingThreshold);
-      break;
-   case CAPixelInterpolation::BicubicBSpline:
-      pixelInterpolation = new BicubicBSplinePixelInterpolation;
-      break;
-   case CAPixelInterpolation::Lanczos3:
-   case CAPixelInterpolation::Lanczos4:
-   case CAPixelInterpolation::Lanczos5:
-
-   {
-      // ### FIXME: Use LUT Lanczos interpolations for 8-bit and 16-bit images
-
-      // Disable clamping when clampingThreshold == 1
-      float clamp = (p_linearClampingThreshold < 1) ? p_linearClampingThreshold : -1;
-      switch (p_pixelInterpolation)
-      {
-      default:
-      case CAPixelInterpolation::Lanczos3:
-         pixelInterpolation = new LanczosPixelInterpolation (3, clamp);
-         break;
-      case CAPixelInterpolation::Lanczos4:
-         pixelInterpolation = new LanczosPixelInterpolation (4, clamp);
-         break;
-      case CAPixelInterpolation::Lanczos5:
-         pixelInterpolation = new LanczosPixelInterpolation (5, clamp);
-         break;
-      }
-   }
-      break;
-   case CAPixelInterpolation::MitchellNetravaliFilter:
-      pixelInterpolation = new BicubicFilterPixelInterpolation (2, 2, MitchellNetravaliCubicFilter ());
-      break;
-   case CAPixelInterpolation::CatmullRomSplineFilter:
-      pixelInterpolation = new BicubicFilterPixelInterpolation (2, 2, CatmullRomSplineFilter ());
-      break;
-   case CAPixelInterpolation::CubicBSplineFilter:
-      pixelInterpolation = new BicubicFilterPixelInterpolation (2, 2, CubicBSplineFilter ());
-      break;
-   }
+   // Resolve the interpolation into warp kernels specialized for each sample type
+   if (m_warp != 0) delete m_warp;
+   m_warp = new WarpEngine (p_pixelInterpolation, p_linearClampingThreshold);
 }
 
 inline ImageVariant* CometAlignmentInstance::LoadOperandImage (const String& filePath)
@@ -1435,7 +2808,7 @@ inline ImageVariant* CometAlignmentInstance::LoadOperandImage (const String& fil
    if ( !file.Open( images, filePath, p_inputHints ) ) throw CatchedException ();
    if (images.IsEmpty ()) throw Error (filePath + ": Empty image file.");
    ImageVariant* img = new ImageVariant ();
-	LoadImageFile (*img, file, images[0].options);
+	LoadImageFile (*img, file, WorkingOptions (images[0].options));
    ProcessInterface::ProcessEvents ();
    console.WriteLn ("Close " + filePath);
    file.Close ();
@@ -1455,6 +2828,9 @@ bool CometAlignmentInstance::ExecuteGlobal ()
 
    m_geometry = 0;
    m_OperandImage = 0;
+   m_warp = 0;
+   m_pool = 0;
+   m_threads = 0;
 
    TreeBox monitor = TheCometAlignmentInterface->GUI->Monitor_TreeBox; 
 
@@ -1473,13 +2849,15 @@ bool CometAlignmentInstance::ExecuteGlobal ()
             console.WriteLn ("Mode: Subtract operand from Targets and align.");
 
          console.WriteLn ("LinearFit " + String (p_enableLinearFit ? "Enabled" : "Disabled")
-                          + String ().Format (", rejection Low:%f, High:%f", p_rejectLow, p_rejectHigh));
+                          + String ().Format (", rejection Low:%f, High:%f", p_rejectLow, p_rejectHigh)
+                          + (p_linearFitSamples ? String ().Format (", samples:%u", p_linearFitSamples) : String ()));
          console.WriteLn ("Normalization " + String (p_normalize ? "Enabled" : "Disabled"));
       }
       else
          console.WriteLn ("Mode: Only align Target images.");
 
       InitPixelInterpolation ();
+      m_pool = new ImagePool;
 
       size_t succeeded = 0;
       size_t skipped = 0;
@@ -1491,6 +2869,7 @@ bool CometAlignmentInstance::ExecuteGlobal ()
 
       const int totalCPU = Thread::NumberOfThreads (1024, 1);
       Console ().Write (String ().Format ("Detected %u CPU. ", totalCPU));
+      m_threads = new WarpThreadPool (totalCPU); // intra-frame warp threads, shared by all frames
 
       const size_t n = Min (size_t (totalCPU), total);
       thread_list runningThreads (n); // n = how many threads will run simultaneously
@@ -1615,6 +2994,7 @@ bool CometAlignmentInstance::ExecuteGlobal ()
             if (*i != 0) //the CPU is idle
             {
                runing--;
+               m_threads->SetConcurrency (runing);
                try
                {				
                   console.WriteLn (String ().Format ("<br>CPU#%u has finished processing.", cpu ));
@@ -1654,8 +3034,8 @@ bool CometAlignmentInstance::ExecuteGlobal ()
                waitingThreads.Remove (waitingThreads.Begin ()); //remove one sub-image from waitingThreads
                console.WriteLn (String ().Format ("<br>CPU#%u processing file ", cpu ) + (*i)->TargetPath());
  
+               m_threads->SetConcurrency (++runing);
 			   (*i)->Start (ThreadPriority::DefaultMax, i - runningThreads.Begin ());
-               runing++;
 			   
 			   TreeBox::Node* node = monitor[cpu];
 			   node->SetText (1, File::ExtractName( (*i)->TargetPath() ) ); //file
@@ -1690,6 +3070,12 @@ bool CometAlignmentInstance::ExecuteGlobal ()
 
       if (m_OperandImage != 0)
          delete m_OperandImage, m_OperandImage = 0;
+      if (m_warp != 0)
+         delete m_warp, m_warp = 0;
+      if (m_pool != 0)
+         delete m_pool, m_pool = 0;
+      if (m_threads != 0)
+         delete m_threads, m_threads = 0;
 
 	  monitor.Clear();
 	  monitor.Hide();
@@ -1709,6 +3095,9 @@ bool CometAlignmentInstance::ExecuteGlobal ()
       Exception::DisableConsoleOutput ();
       Exception::EnableGUIOutput ();
       if (m_OperandImage != 0) delete m_OperandImage, m_OperandImage = 0;
+      if (m_warp != 0) delete m_warp, m_warp = 0;
+      if (m_pool != 0) delete m_pool, m_pool = 0;
+      if (m_threads != 0) delete m_threads, m_threads = 0;
   
 	  monitor.Clear();
 	  monitor.Hide();
@@ -1755,11 +3144,20 @@ void* CometAlignmentInstance::LockParameter (const MetaParameter* p, size_type t
    if (p == TheEnableLinearFit) return &p_enableLinearFit;
    if (p == TheRejectLow) return &p_rejectLow;
    if (p == TheRejectHigh) return &p_rejectHigh;
+   if (p == TheLinearFitSamples) return &p_linearFitSamples;
    if (p == TheDrzSaveSA) return &p_drzSaveSA;
    if (p == TheDrzSaveCA) return &p_drzSaveCA;
 
+   if (p == TheUseROI) return &p_useROI;
+   if (p == TheROIX0) return &p_roi.x0;
+   if (p == TheROIY0) return &p_roi.y0;
+   if (p == TheROIX1) return &p_roi.x1;
+   if (p == TheROIY1) return &p_roi.y1;
+   if (p == TheBinning) return &p_binning;
+
    if (p == TheLinearClampingThresholdParameter) return &p_linearClampingThreshold;
    if (p == ThePixelInterpolationParameter) return &p_pixelInterpolation;
+   if (p == TheFloatWorkingPrecision) return &p_floatWorkingPrecision;
    return 0;
 }
 
@@ -72,6 +72,9 @@ namespace pcl
   typedef IndirectArray<CAThread> thread_list;
 
   struct FileData;
+  class WarpEngine;
+  class ImagePool;
+  class WarpThreadPool;
 
   class CometAlignmentInstance : public ProcessImplementation
   {
@@ -157,6 +160,9 @@ namespace pcl
 
     ImageVariant* m_OperandImage;
     Rect m_geometry;
+    WarpThreadPool* m_threads; // intra-frame warp threads, shared by the frames processed concurrently
+    WarpEngine* m_warp; // warp kernels selected by InitPixelInterpolation ()
+    ImagePool* m_pool; // target and working image buffers, reused across frames until ExecuteGlobal () ends
 
     // instance ---------------------------------------------------------------
     image_list p_targetFrames;
@@ -176,23 +182,31 @@ namespace pcl
     pcl_bool p_enableLinearFit;
     float p_rejectLow;
     float p_rejectHigh;
+    uint32 p_linearFitSamples; // size of the stratified sample used by the linear fit, 0 == every pixel
 	pcl_bool p_drzSaveSA;
 	pcl_bool p_drzSaveCA;
 
+    // Region of interest
+    pcl_bool p_useROI; // true == warp and save only the p_roi crop of each frame
+    Rect p_roi; // in reference frame coordinates
+    int32 p_binning; // quick-look output: each output pixel is the mean of p_binning x p_binning interpolated pixels
+
     // Pixel interpolation
     pcl_enum p_pixelInterpolation; // bicubic spline | bilinear | nearest neighbor
     float p_linearClampingThreshold; // for bicubic spline
+    pcl_bool p_floatWorkingPrecision; // true == process 64-bit float and 32-bit integer images in 32-bit float
 
     // -------------------------------------------------------------------------
 
 	inline thread_list LoadTargetFrame (size_t fileIndex);
     inline String OutputImgPath (const String&, const String&);
-	void Save (const ImageVariant*, CAThread*, const int8);
+	String Save (const ImageVariant*, CAThread*, const int8);
     inline void SaveImage ( CAThread*);
     inline void InitPixelInterpolation ();
+    inline ImageOptions WorkingOptions (const ImageOptions&) const;
     //inline DImage GetCometImage (const String&);
     inline ImageVariant* LoadOperandImage (const String& filePath);
-	FileData* CAReadImage(ImageVariant* img, const String& path );
+	FileData* CAReadImage(ImageVariant*& img, const String& path );
 
     friend class CAThread;
     friend class CometAlignmentInterface;
@@ -438,6 +438,7 @@ void CometAlignmentInterface::UpdateSubtractSection ()
    GUI->LinearFit_CheckBox.Disable(d);
    GUI->RejectLow_NumericControl.Disable(d);
    GUI->RejectHigh_NumericControl.Disable(d);
+   GUI->LinearFitSamples_NumericEdit.Disable(d);
    GUI->SubtractDI_RadioButton.Disable(d);
    GUI->SubtractII_RadioButton.Disable(d);
 
@@ -465,17 +466,31 @@ void CometAlignmentInterface::UpdateControls ()
                                                  m_instance.p_pixelInterpolation == CAPixelInterpolation::BicubicSpline ||
                                                  m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos3 ||
                                                  m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos4 ||
-                                                 m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos5);
+                                                 m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos5 ||
+                                                 m_instance.p_pixelInterpolation == CAPixelInterpolation::FourierShift);
+   GUI->FloatWorkingPrecision_CheckBox.SetChecked (m_instance.p_floatWorkingPrecision);
    GUI->SubtractFile_Edit.SetText (m_instance.p_subtractFile);
 
    GUI->SubtractComet_RadioButton.SetChecked (m_instance.p_subtractMode);
    GUI->SubtractStars_RadioButton.SetChecked (!m_instance.p_subtractMode);
    GUI->DrzSaveSA_CheckBox.SetChecked (m_instance.p_drzSaveSA);
    GUI->DrzSaveCA_CheckBox.SetChecked (m_instance.p_drzSaveCA);
+
+   GUI->UseROI_CheckBox.SetChecked (m_instance.p_useROI);
+   GUI->ROIX0_NumericEdit.SetValue (m_instance.p_roi.x0);
+   GUI->ROIY0_NumericEdit.SetValue (m_instance.p_roi.y0);
+   GUI->ROIX1_NumericEdit.SetValue (m_instance.p_roi.x1);
+   GUI->ROIY1_NumericEdit.SetValue (m_instance.p_roi.y1);
+   GUI->ROIX0_NumericEdit.Enable (m_instance.p_useROI);
+   GUI->ROIY0_NumericEdit.Enable (m_instance.p_useROI);
+   GUI->ROIX1_NumericEdit.Enable (m_instance.p_useROI);
+   GUI->ROIY1_NumericEdit.Enable (m_instance.p_useROI);
+   GUI->Binning_ComboBox.SetCurrentItem (m_instance.p_binning - 1);
    GUI->Normalize_CheckBox.SetChecked (m_instance.p_normalize);
    GUI->LinearFit_CheckBox.SetChecked (m_instance.p_enableLinearFit);
    GUI->RejectLow_NumericControl.SetValue (m_instance.p_rejectLow);
    GUI->RejectHigh_NumericControl.SetValue (m_instance.p_rejectHigh);
+   GUI->LinearFitSamples_NumericEdit.SetValue (m_instance.p_linearFitSamples);
    
    UpdateTargetImagesList ();
    UpdateImageSelectionButtons ();
@@ -1111,6 +1126,13 @@ void CometAlignmentInterface::__Button_Click (Button& sender, bool checked)
    }
    else if (sender == GUI->Overwrite_CheckBox)
       m_instance.p_overwrite = checked;
+   else if (sender == GUI->FloatWorkingPrecision_CheckBox)
+      m_instance.p_floatWorkingPrecision = checked;
+   else if (sender == GUI->UseROI_CheckBox)
+   {
+      m_instance.p_useROI = checked;
+      UpdateControls ();
+   }
    else if (sender == GUI->SubtractStars_RadioButton)
       m_instance.p_subtractMode = !checked;
    else if (sender == GUI->SubtractComet_RadioButton)
@@ -1185,20 +1207,33 @@ void CometAlignmentInterface::__RealValueUpdated (NumericEdit& sender, double va
          UpdateControls ();
       }
    }
+   else if (sender == GUI->LinearFitSamples_NumericEdit)
+      m_instance.p_linearFitSamples = uint32 (value);
    else if (sender == GUI->ClampingThreshold_NumericControl)
       m_instance.p_linearClampingThreshold = value;
+   else if (sender == GUI->ROIX0_NumericEdit)
+      m_instance.p_roi.x0 = int (value);
+   else if (sender == GUI->ROIY0_NumericEdit)
+      m_instance.p_roi.y0 = int (value);
+   else if (sender == GUI->ROIX1_NumericEdit)
+      m_instance.p_roi.x1 = int (value);
+   else if (sender == GUI->ROIY1_NumericEdit)
+      m_instance.p_roi.y1 = int (value);
 }
 
 void CometAlignmentInterface::__ItemSelected (ComboBox& sender, int itemIndex)
 {
-   if (sender == GUI->PixelInterpolation_ComboBox)
+   if (sender == GUI->Binning_ComboBox)
+      m_instance.p_binning = itemIndex + 1;
+   else if (sender == GUI->PixelInterpolation_ComboBox)
    {
       m_instance.p_pixelInterpolation = itemIndex;
       GUI->ClampingThreshold_NumericControl.Enable (
                                                     m_instance.p_pixelInterpolation == CAPixelInterpolation::BicubicSpline ||
                                                     m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos3 ||
                                                     m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos4 ||
-                                                    m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos5);
+                                                    m_instance.p_pixelInterpolation == CAPixelInterpolation::Lanczos5 ||
+                                                    m_instance.p_pixelInterpolation == CAPixelInterpolation::FourierShift);
    }
 }
 
@@ -1444,10 +1479,71 @@ CometAlignmentInterface::GUIData::GUIData (CometAlignmentInterface& w)
    OutputChunks_Sizer.Add (Overwrite_CheckBox);
    OutputChunks_Sizer.AddStretch ();
 
+   const char* roiToolTip = "<p>Region of interest: left, top, right and bottom coordinates of a rectangle in "
+      "the registered frame. If enabled, CometAlignment generates and writes only this region of each output image, "
+      "for example a crop centred on the comet. The rectangle is clipped to the bounds of each frame.</p>";
+
+   UseROI_CheckBox.SetText ("Region of interest");
+   UseROI_CheckBox.SetToolTip (roiToolTip);
+   UseROI_CheckBox.OnClick ((Button::click_event_handler) & CometAlignmentInterface::__Button_Click, w);
+
+   ROIX0_NumericEdit.label.SetText ("Left:");
+   ROIX0_NumericEdit.SetInteger ();
+   ROIX0_NumericEdit.SetRange (0, int_max);
+   ROIX0_NumericEdit.OnValueUpdated ((NumericEdit::value_event_handler) & CometAlignmentInterface::__RealValueUpdated, w);
+   ROIX0_NumericEdit.SetToolTip (roiToolTip);
+
+   ROIY0_NumericEdit.label.SetText ("Top:");
+   ROIY0_NumericEdit.SetInteger ();
+   ROIY0_NumericEdit.SetRange (0, int_max);
+   ROIY0_NumericEdit.OnValueUpdated ((NumericEdit::value_event_handler) & CometAlignmentInterface::__RealValueUpdated, w);
+   ROIY0_NumericEdit.SetToolTip (roiToolTip);
+
+   ROIX1_NumericEdit.label.SetText ("Right:");
+   ROIX1_NumericEdit.SetInteger ();
+   ROIX1_NumericEdit.SetRange (0, int_max);
+   ROIX1_NumericEdit.OnValueUpdated ((NumericEdit::value_event_handler) & CometAlignmentInterface::__RealValueUpdated, w);
+   ROIX1_NumericEdit.SetToolTip (roiToolTip);
+
+   ROIY1_NumericEdit.label.SetText ("Bottom:");
+   ROIY1_NumericEdit.SetInteger ();
+   ROIY1_NumericEdit.SetRange (0, int_max);
+   ROIY1_NumericEdit.OnValueUpdated ((NumericEdit::value_event_handler) & CometAlignmentInterface::__RealValueUpdated, w);
+   ROIY1_NumericEdit.SetToolTip (roiToolTip);
+
+   const char* binningToolTip = "<p>Quick-look binning. Each output pixel is the mean of binning x binning "
+      "interpolated pixels, computed in the same pass as the alignment, so output images are smaller by the square of "
+      "the binning factor. Comet coordinates are always given at full resolution; the pixel scale keywords of "
+      "output images are rescaled.</p>";
+
+   Binning_Label.SetText ("Binning:");
+   Binning_Label.SetTextAlignment (TextAlign::Right | TextAlign::VertCenter);
+   Binning_Label.SetToolTip (binningToolTip);
+
+   Binning_ComboBox.AddItem ("1x1");
+   Binning_ComboBox.AddItem ("2x2");
+   Binning_ComboBox.AddItem ("3x3");
+   Binning_ComboBox.AddItem ("4x4");
+   Binning_ComboBox.SetToolTip (binningToolTip);
+   Binning_ComboBox.OnItemSelected ((ComboBox::item_event_handler) & CometAlignmentInterface::__ItemSelected, w);
+
+   ROI_Sizer.SetSpacing (4);
+   ROI_Sizer.Add (UseROI_CheckBox);
+   ROI_Sizer.AddSpacing (12);
+   ROI_Sizer.Add (ROIX0_NumericEdit);
+   ROI_Sizer.Add (ROIY0_NumericEdit);
+   ROI_Sizer.Add (ROIX1_NumericEdit);
+   ROI_Sizer.Add (ROIY1_NumericEdit);
+   ROI_Sizer.AddSpacing (20);
+   ROI_Sizer.Add (Binning_Label);
+   ROI_Sizer.Add (Binning_ComboBox);
+   ROI_Sizer.AddStretch ();
+
    //---------------------------------------------------
    Output_Sizer.SetSpacing (4);
    Output_Sizer.Add (OutputDir_Sizer);
    Output_Sizer.Add (OutputChunks_Sizer);
+   Output_Sizer.Add (ROI_Sizer);
    
 
    Output_Control.SetSizer (Output_Sizer);
@@ -1720,12 +1816,25 @@ CometAlignmentInterface::GUIData::GUIData (CometAlignmentInterface& w)
 	
    //
 
+   LinearFitSamples_NumericEdit.label.SetText ("Fit samples:");
+   LinearFitSamples_NumericEdit.label.SetFixedWidth (labelWidth1);
+   LinearFitSamples_NumericEdit.SetInteger ();
+   LinearFitSamples_NumericEdit.SetRange (TheLinearFitSamples->MinimumValue (), int_max);
+   LinearFitSamples_NumericEdit.SetToolTip ("<p>Number of pixels used by LinearFit, taken from a regular grid with a fixed "
+                                            "random offset in each cell, so the result is the same on every run. The cost of the fit then does not depend "
+                                            "on the image size. Zero uses every pixel.</p>"
+                                            "<p>The standard errors of the fitted coefficients are reported in the console and in the HISTORY keywords.</p>");
+   LinearFitSamples_NumericEdit.OnValueUpdated ((NumericEdit::value_event_handler) & CometAlignmentInterface::__RealValueUpdated, w);
+
+   //
+
    Subtract_Sizer.SetSpacing (4);
    Subtract_Sizer.Add (SubtractFile_Sizer);
    Subtract_Sizer.Add (SubtractImgOption_Sizer);
    Subtract_Sizer.Add (SubtractChekers_Sizer);
    Subtract_Sizer.Add (RejectLow_NumericControl);
    Subtract_Sizer.Add (RejectHigh_NumericControl);
+   Subtract_Sizer.Add (LinearFitSamples_NumericEdit);
 
    //---------------------------------------------------
 
@@ -1756,7 +1865,12 @@ CometAlignmentInterface::GUIData::GUIData (CometAlignmentInterface& w)
            "worst results, especially in terms of registration accuracy (no subpixel registration is possible), and "
            "discontinuities due to the simplistic interpolation scheme. However, in absence of scaling and rotation "
            "nearest neighbor preserves the original noise distribution in the registered images, a property that can "
-           "be useful in some image analysis applications.</p>";
+           "be useful in some image analysis applications.</p>"
+           "<p><b>Fourier shift</b> applies comet translations as a phase ramp in the frequency domain. The shift is "
+           "exact for band-limited data, without kernel truncation, and on large frames it is faster than Lanczos-5. "
+           "It generates ringing artifacts around sharp features, which the clamping mechanism cannot fix. "
+           "Transformations other than translations (drizzle data) are applied with Lanczos-3 interpolation, subject to "
+           "the clamping threshold.</p>";
 
    PixelInterpolation_Label.SetText ("Pixel interpolation:");
    PixelInterpolation_Label.SetFixedWidth (labelWidth1);
@@ -1773,6 +1887,8 @@ CometAlignmentInterface::GUIData::GUIData (CometAlignmentInterface& w)
    PixelInterpolation_ComboBox.AddItem ("Mitchell-Netravali Filter");
    PixelInterpolation_ComboBox.AddItem ("Catmull-Rom Spline Filter");
    PixelInterpolation_ComboBox.AddItem ("Cubic B-Spline Filter");
+   PixelInterpolation_ComboBox.AddItem ("Auto");
+   PixelInterpolation_ComboBox.AddItem ("Fourier Shift");
    PixelInterpolation_ComboBox.SetMaxVisibleItemCount (16);
    PixelInterpolation_ComboBox.SetToolTip (pixelInterpolationToolTip);
    PixelInterpolation_ComboBox.OnItemSelected ((ComboBox::item_event_handler) & CometAlignmentInterface::__ItemSelected, w);
@@ -1802,9 +1918,17 @@ CometAlignmentInterface::GUIData::GUIData (CometAlignmentInterface& w)
          "in terms of aliasing and detail preservation.</p>");
    ClampingThreshold_NumericControl.OnValueUpdated ((NumericEdit::value_event_handler) & CometAlignmentInterface::__RealValueUpdated, w);
 
+   FloatWorkingPrecision_CheckBox.SetText ("32-bit floating point working precision");
+   FloatWorkingPrecision_CheckBox.SetToolTip ("<p>Read, align and subtract 64-bit floating point and 32-bit integer "
+                                              "images in 32-bit floating point format, which halves their memory usage "
+                                              "and processing time. Output images are written in the sample format of "
+                                              "their source images.</p>");
+   FloatWorkingPrecision_CheckBox.OnClick ((Button::click_event_handler) & CometAlignmentInterface::__Button_Click, w);
+
    Interpolation_Sizer.SetSpacing (4);
    Interpolation_Sizer.Add (PixelInterpolation_Sizer);
    Interpolation_Sizer.Add (ClampingThreshold_NumericControl);
+   Interpolation_Sizer.Add (FloatWorkingPrecision_CheckBox);
 
    Interpolation_Control.SetSizer (Interpolation_Sizer);
 
@@ -159,6 +159,14 @@ namespace pcl
                Edit              Prefix_Edit;
                Label             Postfix_Label;
                Edit              Postfix_Edit;
+            HorizontalSizer   ROI_Sizer;
+               CheckBox          UseROI_CheckBox;
+               NumericEdit       ROIX0_NumericEdit;
+               NumericEdit       ROIY0_NumericEdit;
+               NumericEdit       ROIX1_NumericEdit;
+               NumericEdit       ROIY1_NumericEdit;
+               Label             Binning_Label;
+               ComboBox          Binning_ComboBox;
 
     SectionBar		Parameter_SectionBar;
     Control			Parameter_Control;
@@ -203,6 +211,7 @@ namespace pcl
 			CheckBox		Normalize_CheckBox;
 			NumericControl	RejectLow_NumericControl;
 			NumericControl	RejectHigh_NumericControl;
+			NumericEdit		LinearFitSamples_NumericEdit;
 		
 	SectionBar		Interpolation_SectionBar;
 	Control			Interpolation_Control;
@@ -211,6 +220,7 @@ namespace pcl
 			Label			PixelInterpolation_Label;
 			ComboBox		PixelInterpolation_ComboBox;
 			NumericControl	ClampingThreshold_NumericControl;
+		CheckBox		FloatWorkingPrecision_CheckBox;
     };
 
     GUIData* GUI;
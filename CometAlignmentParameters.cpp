@@ -83,11 +83,20 @@ CANormalize* TheNormalize = 0;
 CAEnableLinearFit* TheEnableLinearFit = 0;
 CARejectLow* TheRejectLow = 0;
 CARejectHigh* TheRejectHigh = 0;
+CALinearFitSamples* TheLinearFitSamples = 0;
 CADrzSaveSA* TheDrzSaveSA =0;
 CADrzSaveCA* TheDrzSaveCA =0;
 
+CAUseROI* TheUseROI = 0;
+CAROIX0* TheROIX0 = 0;
+CAROIY0* TheROIY0 = 0;
+CAROIX1* TheROIX1 = 0;
+CAROIY1* TheROIY1 = 0;
+CABinning* TheBinning = 0;
+
 CAPixelInterpolation* ThePixelInterpolationParameter = 0;
 CALinearClampingThreshold* TheLinearClampingThresholdParameter = 0;
+CAFloatWorkingPrecision* TheFloatWorkingPrecision = 0;
 
 // ----------------------------------------------------------------------------
 
@@ -481,6 +490,33 @@ double CARejectHigh::DefaultValue () const
 
 // ----------------------------------------------------------------------------
 
+CALinearFitSamples::CALinearFitSamples (MetaProcess* P) : MetaUInt32 (P)
+{
+   TheLinearFitSamples = this;
+}
+
+IsoString CALinearFitSamples::Id () const
+{
+   return "linearFitSamples";
+}
+
+double CALinearFitSamples::DefaultValue () const
+{
+   return 0; // every pixel
+}
+
+double CALinearFitSamples::MinimumValue () const
+{
+   return 0;
+}
+
+double CALinearFitSamples::MaximumValue () const
+{
+   return uint32_max;
+}
+
+// ----------------------------------------------------------------------------
+
 CADrzSaveSA::CADrzSaveSA (MetaProcess* P) : MetaBoolean (P)
 {
    TheDrzSaveSA = this;
@@ -531,6 +567,118 @@ bool CAOperandIsDI::DefaultValue () const
 
 // ----------------------------------------------------------------------------
 
+CAUseROI::CAUseROI (MetaProcess* P) : MetaBoolean (P)
+{
+   TheUseROI = this;
+}
+
+IsoString CAUseROI::Id () const
+{
+   return "useROI";
+}
+
+bool CAUseROI::DefaultValue () const
+{
+   return false;
+}
+
+// ----------------------------------------------------------------------------
+
+CAROIX0::CAROIX0 (MetaProcess* P) : MetaInt32 (P)
+{
+   TheROIX0 = this;
+}
+
+IsoString CAROIX0::Id () const
+{
+   return "roiX0";
+}
+
+double CAROIX0::DefaultValue () const
+{
+   return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+CAROIY0::CAROIY0 (MetaProcess* P) : MetaInt32 (P)
+{
+   TheROIY0 = this;
+}
+
+IsoString CAROIY0::Id () const
+{
+   return "roiY0";
+}
+
+double CAROIY0::DefaultValue () const
+{
+   return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+CAROIX1::CAROIX1 (MetaProcess* P) : MetaInt32 (P)
+{
+   TheROIX1 = this;
+}
+
+IsoString CAROIX1::Id () const
+{
+   return "roiX1";
+}
+
+double CAROIX1::DefaultValue () const
+{
+   return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+CAROIY1::CAROIY1 (MetaProcess* P) : MetaInt32 (P)
+{
+   TheROIY1 = this;
+}
+
+IsoString CAROIY1::Id () const
+{
+   return "roiY1";
+}
+
+double CAROIY1::DefaultValue () const
+{
+   return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+CABinning::CABinning (MetaProcess* P) : MetaInt32 (P)
+{
+   TheBinning = this;
+}
+
+IsoString CABinning::Id () const
+{
+   return "binning";
+}
+
+double CABinning::DefaultValue () const
+{
+   return 1;
+}
+
+double CABinning::MinimumValue () const
+{
+   return 1;
+}
+
+double CABinning::MaximumValue () const
+{
+   return 4;
+}
+
+// ----------------------------------------------------------------------------
+
 CAPixelInterpolation::CAPixelInterpolation (MetaProcess* p) : MetaEnumeration (p)
 {
    ThePixelInterpolationParameter = this;
@@ -562,6 +710,7 @@ IsoString CAPixelInterpolation::ElementId (size_type i) const
    case CatmullRomSplineFilter: return "CatmullRomSplineFilter";
    case CubicBSplineFilter: return "CubicBSplineFilter";
    case Auto: return "Auto";
+   case FourierShift: return "FourierShift";
    }
 }
 
@@ -607,6 +756,23 @@ double CALinearClampingThreshold::MaximumValue () const
    return 1;
 }
 
+// ----------------------------------------------------------------------------
+
+CAFloatWorkingPrecision::CAFloatWorkingPrecision (MetaProcess* P) : MetaBoolean (P)
+{
+   TheFloatWorkingPrecision = this;
+}
+
+IsoString CAFloatWorkingPrecision::Id () const
+{
+   return "floatWorkingPrecision";
+}
+
+bool CAFloatWorkingPrecision::DefaultValue () const
+{
+   return false;
+}
+
 // ----------------------------------------------------------------------------
 } // pcl
 
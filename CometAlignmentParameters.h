@@ -241,6 +241,18 @@ namespace pcl
     virtual double MaximumValue () const;
     virtual double DefaultValue () const;
   };
+
+  // ----------------------------------------------------------------------------
+
+  class CALinearFitSamples : public MetaUInt32
+  {
+  public:
+    CALinearFitSamples (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual double DefaultValue () const;
+    virtual double MinimumValue () const;
+    virtual double MaximumValue () const;
+  };
   // ----------------------------------------------------------------------------
 
   class CANormalize : public MetaBoolean
@@ -283,6 +295,60 @@ namespace pcl
 
   // ----------------------------------------------------------------------------
 
+  class CAUseROI : public MetaBoolean
+  {
+  public:
+    CAUseROI (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual bool DefaultValue () const;
+  };
+
+  class CAROIX0 : public MetaInt32
+  {
+  public:
+    CAROIX0 (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual double DefaultValue () const;
+  };
+
+  class CAROIY0 : public MetaInt32
+  {
+  public:
+    CAROIY0 (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual double DefaultValue () const;
+  };
+
+  class CAROIX1 : public MetaInt32
+  {
+  public:
+    CAROIX1 (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual double DefaultValue () const;
+  };
+
+  class CAROIY1 : public MetaInt32
+  {
+  public:
+    CAROIY1 (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual double DefaultValue () const;
+  };
+
+  // ----------------------------------------------------------------------------
+
+  class CABinning : public MetaInt32
+  {
+  public:
+    CABinning (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual double DefaultValue () const;
+    virtual double MinimumValue () const;
+    virtual double MaximumValue () const;
+  };
+
+  // ----------------------------------------------------------------------------
+
   class CAPixelInterpolation : public MetaEnumeration
   {
   public:
@@ -300,6 +366,7 @@ namespace pcl
       CatmullRomSplineFilter,
       CubicBSplineFilter,
       Auto,
+      FourierShift,
       NumberOfInterpolationAlgorithms,
       Default = BicubicSpline
     };
@@ -313,6 +380,14 @@ namespace pcl
     virtual size_type DefaultValueIndex () const;
   };
 
+  class CAFloatWorkingPrecision : public MetaBoolean
+  {
+  public:
+    CAFloatWorkingPrecision (MetaProcess*);
+    virtual IsoString Id () const;
+    virtual bool DefaultValue () const;
+  };
+
   class CALinearClampingThreshold : public MetaFloat
   {
   public:
@@ -356,12 +431,21 @@ namespace pcl
    extern CAEnableLinearFit* TheEnableLinearFit;
    extern CARejectLow* TheRejectLow;
    extern CARejectHigh* TheRejectHigh;
+   extern CALinearFitSamples* TheLinearFitSamples;
    extern CANormalize* TheNormalize;
    extern CADrzSaveSA* TheDrzSaveSA;
    extern CADrzSaveCA* TheDrzSaveCA;
 
+   extern CAUseROI* TheUseROI;
+   extern CAROIX0* TheROIX0;
+   extern CAROIY0* TheROIY0;
+   extern CAROIX1* TheROIX1;
+   extern CAROIY1* TheROIY1;
+   extern CABinning* TheBinning;
+
    extern CAPixelInterpolation* ThePixelInterpolationParameter;
    extern CALinearClampingThreshold* TheLinearClampingThresholdParameter;
+   extern CAFloatWorkingPrecision* TheFloatWorkingPrecision;
 
   // ----------------------------------------------------------------------------
   PCL_END_LOCAL
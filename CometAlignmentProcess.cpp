@@ -97,13 +97,22 @@ CometAlignmentProcess::CometAlignmentProcess () : MetaProcess ()
    new CAEnableLinearFit (this);
    new CARejectLow (this);
    new CARejectHigh (this);
+   new CALinearFitSamples (this);
    new CANormalize (this);
    new CADrzSaveSA (this);
    new CADrzSaveCA (this);
    new CAOperandIsDI (this);
 
+   new CAUseROI (this);
+   new CAROIX0 (this);
+   new CAROIY0 (this);
+   new CAROIX1 (this);
+   new CAROIY1 (this);
+   new CABinning (this);
+
    new CAPixelInterpolation (this);
    new CALinearClampingThreshold (this);
+   new CAFloatWorkingPrecision (this);
 }
 
 // ----------------------------------------------------------------------------
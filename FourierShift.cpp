@@ -0,0 +1,101 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// FourierShift.cpp - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#include "FourierShift.h"
+
+#include <pcl/Math.h>
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+template <typename T>
+FourierLineShift<T>::FourierLineShift( int n, double f ) :
+m_n( n ), m_fft( n ), m_ramp( n/2 + 1 ), m_spectrum( n/2 + 1 )
+{
+   // Unnormalized transforms: scale by 1/n along with the ramp.
+   const double twoPi = 2*Const<double>::pi();
+   for ( int k = 0; k <= n/2; ++k )
+      if ( 2*k == n )
+         m_ramp[k] = complex( T( Cos( Const<double>::pi()*f )/n ), T( 0 ) );
+      else
+      {
+         double a = twoPi*k*f/n;
+         m_ramp[k] = complex( T( Cos( a )/n ), T( Sin( a )/n ) );
+      }
+}
+
+template <typename T>
+void FourierLineShift<T>::operator()( T* x )
+{
+   m_fft( m_spectrum.Begin(), x );
+   for ( int k = 0; k <= m_n/2; ++k )
+      m_spectrum[k] *= m_ramp[k];
+   m_fft( x, m_spectrum.Begin() );
+}
+
+template <typename T>
+int FourierLineShift<T>::OptimizedLength( int n )
+{
+   int m = FFT1DBase::OptimizedLength( n );
+   while ( m & 1 )
+      m = FFT1DBase::OptimizedLength( m+1 );
+   return m;
+}
+
+template class FourierLineShift<float>;
+template class FourierLineShift<double>;
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+// ****************************************************************************
+// EOF FourierShift.cpp - Released 2015/03/04 19:50:08 UTC
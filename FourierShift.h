@@ -0,0 +1,111 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// FourierShift.h - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#ifndef __FourierShift_h
+#define __FourierShift_h
+
+#include <pcl/Array.h>
+#include <pcl/FFT1D.h>
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Sub-pixel shift of real sequences of length n in the frequency domain: a
+ * sequence is replaced by the band-limited interpolation of its periodic
+ * extension at x+f. The spectrum is multiplied by the phase ramp
+ * exp( 2*pi*i*k*f/n ); the Nyquist frequency of even lengths takes the real
+ * factor cos( pi*f ), which keeps the result real.
+ *
+ * The ramp of a 2-D shift is separable, so shifting every row of a plane and
+ * then every column is its 2-D shift. Each object has its own FFT plan and
+ * spectrum buffer, so it must be used by a single thread.
+ */
+template <typename T>
+class FourierLineShift
+{
+public:
+
+   typedef typename GenericRealFFT<T>::complex complex;
+
+   FourierLineShift( int n, double f );
+
+   int Length() const
+   {
+      return m_n;
+   }
+
+   /*
+    * Shifts n contiguous samples in place.
+    */
+   void operator()( T* x );
+
+   /*
+    * Smallest even length >= n with fast FFT factorization.
+    */
+   static int OptimizedLength( int n );
+
+private:
+
+   int               m_n;
+   GenericRealFFT<T> m_fft;
+   Array<complex>    m_ramp;
+   Array<complex>    m_spectrum;
+};
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+#endif   // __FourierShift_h
+
+// ****************************************************************************
+// EOF FourierShift.h - Released 2015/03/04 19:50:08 UTC
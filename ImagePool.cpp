@@ -0,0 +1,128 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// ImagePool.cpp - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#include "ImagePool.h"
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+static bool Matches( const ImageVariant& image, bool floatSample, int bitsPerSample,
+                     int width, int height, int numberOfChannels )
+{
+   return image && image.IsFloatSample() == floatSample && !image.IsComplexSample()
+       && image.BitsPerSample() == bitsPerSample && image.Width() == width && image.Height() == height
+       && image.NumberOfChannels() == numberOfChannels;
+}
+
+ImageVariant* ImagePool::Acquire( bool floatSample, int bitsPerSample,
+                                  int width, int height, int numberOfChannels, color_space colorSpace )
+{
+   Buffer* buffer = 0;
+   Buffer* idle = 0;
+   m_mutex.Lock();
+   for ( size_type i = 0; i < m_buffers.Length(); ++i )
+   {
+      Buffer* b = m_buffers[i];
+      if ( !b->busy )
+      {
+         if ( Matches( b->image, floatSample, bitsPerSample, width, height, numberOfChannels ) )
+         {
+            buffer = b;
+            break;
+         }
+         if ( idle == 0 )
+            idle = b;
+      }
+   }
+   bool allocate = buffer == 0;
+   if ( allocate )
+   {
+      if ( idle != 0 )
+         buffer = idle;
+      else
+         m_buffers.Add( buffer = new Buffer );
+   }
+   buffer->busy = true;
+   m_mutex.Unlock();
+
+   // Allocation is the expensive part: don't hold the lock meanwhile.
+   // Buffers are local images: Acquire() runs on worker threads, where no
+   // shared image can be created, and the buffers never reach a view.
+   if ( allocate )
+   {
+      buffer->image.FreeImage();
+      buffer->image.CreateImage( floatSample, false, bitsPerSample );
+   }
+   // With the same geometry, this only sets the color space.
+   buffer->image.AllocateData( width, height, numberOfChannels, colorSpace );
+   return &buffer->image;
+}
+
+void ImagePool::Release( ImageVariant* image )
+{
+   if ( image == 0 )
+      return;
+   m_mutex.Lock();
+   for ( size_type i = 0; i < m_buffers.Length(); ++i )
+      if ( &m_buffers[i]->image == image )
+      {
+         m_buffers[i]->busy = false;
+         break;
+      }
+   m_mutex.Unlock();
+}
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+// ****************************************************************************
+// EOF ImagePool.cpp - Released 2015/03/04 19:50:08 UTC
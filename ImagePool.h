@@ -0,0 +1,136 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// ImagePool.h - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#ifndef __ImagePool_h
+#define __ImagePool_h
+
+#include <pcl/Array.h>
+#include <pcl/ImageVariant.h>
+#include <pcl/Mutex.h>
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Pool of image buffers reused across frames by the worker threads.
+ *
+ * Buffers are keyed by sample type and geometry. A buffer is reserved for the
+ * caller by Acquire() until it is released, and keeps its pixel data when it
+ * is released, so a later request for the same key is served without any
+ * allocation. When no idle buffer matches a request, an idle buffer of
+ * another key is reallocated before a new one is created, so the pool never
+ * holds more buffers than have been in use at the same time.
+ *
+ * All buffers are freed when the pool is destroyed.
+ */
+class ImagePool
+{
+public:
+
+   ImagePool()
+   {
+   }
+
+   ~ImagePool()
+   {
+      m_buffers.Destroy();
+   }
+
+   /*
+    * Returns a width x height image with numberOfChannels channels of the
+    * specified sample type, reserved for the caller until it is released.
+    * The pixel data are not initialized.
+    */
+   ImageVariant* Acquire( bool floatSample, int bitsPerSample,
+                          int width, int height, int numberOfChannels, color_space colorSpace );
+
+   /*
+    * Returns an image with the sample type and geometry of the specified one.
+    */
+   ImageVariant* Acquire( const ImageVariant& image )
+   {
+      return Acquire( image.IsFloatSample(), image.BitsPerSample(),
+                      image.Width(), image.Height(), image.NumberOfChannels(), image.ColorSpace() );
+   }
+
+   /*
+    * Returns an image to the pool. Does nothing if image is zero.
+    */
+   void Release( ImageVariant* image );
+
+private:
+
+   struct Buffer
+   {
+      ImageVariant image;
+      bool         busy;
+
+      Buffer() : image(), busy( true )
+      {
+      }
+   };
+
+   Mutex                 m_mutex;
+   IndirectArray<Buffer> m_buffers;
+
+   // Not copyable: buffers are owned by the pool.
+   ImagePool( const ImagePool& );
+   void operator =( const ImagePool& );
+};
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+#endif   // __ImagePool_h
+
+// ****************************************************************************
+// EOF ImagePool.h - Released 2015/03/04 19:50:08 UTC
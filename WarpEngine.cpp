@@ -0,0 +1,654 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// WarpEngine.cpp - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#include "WarpEngine.h"
+
+#include <pcl/Exception.h>
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+static double MitchellNetravali( double x, double B, double C )
+{
+   x = Abs( x );
+   if ( x < 1 )
+      return ((12 - 9*B - 6*C)*x*x*x + (-18 + 12*B + 6*C)*x*x + (6 - 2*B))/6;
+   if ( x < 2 )
+      return ((-B - 6*C)*x*x*x + (6*B + 30*C)*x*x + (-12*B - 48*C)*x + (8*B + 24*C))/6;
+   return 0;
+}
+
+static double Lanczos( double x, int n )
+{
+   x = Abs( x );
+   if ( x < 1.0e-08 )
+      return 1;
+   if ( x >= n )
+      return 0;
+   double px = Const<double>::pi()*x;
+   return n*Sin( px )*Sin( px/n )/px/px;
+}
+
+// ----------------------------------------------------------------------------
+
+WarpKernel::WarpKernel( pcl_enum interpolation, float clampingThreshold, bool lut ) :
+m_interpolation( interpolation ), m_taps( 4 ), m_clampMode( NoClamp ), m_clamp( clampingThreshold ), m_B( 0 ), m_C( 0.5 ),
+m_interpolating( true ), m_lut()
+{
+   switch ( m_interpolation )
+   {
+   case CAPixelInterpolation::NearestNeighbor:
+   case CAPixelInterpolation::Bilinear:
+      m_taps = 2;
+      break;
+   default: // Auto
+      m_interpolation = CAPixelInterpolation::BicubicSpline;
+      // fall through
+   case CAPixelInterpolation::BicubicSpline:
+      m_clampMode = SplineClamp;
+      break;
+   case CAPixelInterpolation::BicubicBSpline:
+   case CAPixelInterpolation::CubicBSplineFilter:
+      m_B = 1;
+      m_C = 0;
+      break;
+   case CAPixelInterpolation::MitchellNetravaliFilter:
+      m_B = m_C = 1.0/3;
+      break;
+   case CAPixelInterpolation::CatmullRomSplineFilter:
+      break;
+   case CAPixelInterpolation::Lanczos3:
+   case CAPixelInterpolation::Lanczos4:
+   case CAPixelInterpolation::Lanczos5:
+      m_taps = 2*(3 + m_interpolation - CAPixelInterpolation::Lanczos3);
+      // Disable clamping when clampingThreshold == 1
+      if ( m_clamp < 1 )
+         m_clampMode = LanczosClamp;
+      if ( lut )
+      {
+         int r = m_taps >> 1;
+         m_lut = Array<double>( size_type( r*LUTResolution + 2 ) );
+         for ( int i = 0; i <= r*LUTResolution; ++i )
+            m_lut[i] = Lanczos( double( i )/LUTResolution, r );
+         m_lut[r*LUTResolution + 1] = 0;
+      }
+      break;
+   }
+
+   if ( lut && m_taps == 4 )
+   {
+      // The four weights of each phase i/LUTResolution, i = 0..LUTResolution.
+      m_lut = Array<double>( size_type( 4*(LUTResolution + 1) ) );
+      for ( int i = 0; i <= LUTResolution; ++i )
+         for ( int k = 0; k < 4; ++k )
+            m_lut[4*i + k] = MitchellNetravali( k - 1 - double( i )/LUTResolution, m_B, m_C );
+   }
+
+   double w[ MaxTaps ];
+   Weights( w, 0 );
+   for ( int k = 0; k < m_taps; ++k )
+      if ( Abs( w[k] - ((k == -Origin()) ? 1 : 0) ) > 1.0e-12 )
+         m_interpolating = false;
+}
+
+void WarpKernel::Weights( double* w, double dx ) const
+{
+   switch ( m_interpolation )
+   {
+   case CAPixelInterpolation::NearestNeighbor:
+      w[0] = (dx < 0.5) ? 1 : 0;
+      w[1] = 1 - w[0];
+      break;
+   case CAPixelInterpolation::Bilinear:
+      w[0] = 1 - dx;
+      w[1] = dx;
+      break;
+   case CAPixelInterpolation::Lanczos3:
+   case CAPixelInterpolation::Lanczos4:
+   case CAPixelInterpolation::Lanczos5:
+      {
+         int r = m_taps >> 1;
+         double s = 0;
+         if ( m_lut.IsEmpty() )
+            for ( int k = 0; k < m_taps; ++k )
+               s += w[k] = Lanczos( k + Origin() - dx, r );
+         else
+            for ( int k = 0; k < m_taps; ++k )
+               s += w[k] = LanczosLUT( k + Origin() - dx );
+         for ( int k = 0; k < m_taps; ++k )
+            w[k] /= s;
+      }
+      break;
+   default:
+      if ( m_lut.IsEmpty() )
+         for ( int k = 0; k < 4; ++k )
+            w[k] = MitchellNetravali( k - 1 - dx, m_B, m_C );
+      else
+      {
+         double t = dx*LUTResolution;
+         int i = Range( TruncInt( t ), 0, LUTResolution-1 );
+         t -= i;
+         const double* w0 = m_lut.Begin() + 4*i;
+         const double* w1 = w0 + 4;
+         for ( int k = 0; k < 4; ++k )
+            w[k] = w0[k] + t*(w1[k] - w0[k]);
+      }
+      break;
+   }
+}
+
+// ----------------------------------------------------------------------------
+
+bool IsTranslationMatrix( const Matrix& M )
+{
+   const double eps = 1.0e-12;
+   return M.Rows() == 3 && M.Cols() == 3 && Abs( M[2][2] ) > eps
+       && Abs( M[0][0] - M[2][2] ) < eps*Abs( M[2][2] ) && Abs( M[0][1] ) < eps
+       && Abs( M[1][1] - M[2][2] ) < eps*Abs( M[2][2] ) && Abs( M[1][0] ) < eps
+       && Abs( M[2][0] ) < eps && Abs( M[2][1] ) < eps;
+}
+
+bool IsAffineMatrix( const Matrix& M )
+{
+   return M[2][0] == 0 && M[2][1] == 0;
+}
+
+// ----------------------------------------------------------------------------
+
+WarpTransform::WarpTransform( const Matrix& H )
+{
+   const double h22 = H[2][2];
+   for ( int i = 0, k = 0; i < 3; ++i )
+      for ( int j = 0; j < 3; ++j, ++k )
+         m_H[k] = H[i][j]/h22;
+   m_affine = m_H[6] == 0 && m_H[7] == 0;
+}
+
+/*
+ * Narrows the real interval [k0,k1] to the values of k where A + k*B >= 0.
+ */
+static void ClipSpan( double& k0, double& k1, double A, double B )
+{
+   if ( B > 0 )
+      k0 = Max( k0, -A/B );
+   else if ( B < 0 )
+      k1 = Min( k1, -A/B );
+   else if ( A < 0 )
+      k1 = k0 - 1;
+}
+
+void WarpTransform::Span( int& x0, int& x1, int y, int width, double xmin, double xmax, double ymin, double ymax ) const
+{
+   const double X0 = m_H[1]*y + m_H[2];
+   const double Y0 = m_H[4]*y + m_H[5];
+   const double W0 = m_affine ? 1.0 : m_H[7]*y + m_H[8];
+   const double dX = m_H[0];
+   const double dY = m_H[3];
+   const double dW = m_affine ? 0.0 : m_H[6];
+
+   // With W > 0, xmin <= X/W < xmax <=> X - xmin*W >= 0 and xmax*W - X > 0.
+   double k0 = -1, k1 = width;
+   if ( !m_affine )
+      ClipSpan( k0, k1, W0, dW );
+   ClipSpan( k0, k1, X0 - xmin*W0, dX - xmin*dW );
+   ClipSpan( k0, k1, xmax*W0 - X0, xmax*dW - dX );
+   ClipSpan( k0, k1, Y0 - ymin*W0, dY - ymin*dW );
+   ClipSpan( k0, k1, ymax*W0 - Y0, ymax*dW - dY );
+
+   x0 = TruncInt( Range( Ceil( k0 ), 0.0, double( width ) ) );
+   x1 = (k1 < k0) ? x0 : TruncInt( Range( Floor( k1 ) + 1, double( x0 ), double( width ) ) );
+
+   // Settle rounding at the span ends with the coordinates of Row().
+   while ( x0 < x1 && !Inside( x0, y, xmin, xmax, ymin, ymax ) )
+      ++x0;
+   while ( x1 > x0 && !Inside( x1-1, y, xmin, xmax, ymin, ymax ) )
+      --x1;
+   if ( x0 < x1 )
+   {
+      while ( x0 > 0 && Inside( x0-1, y, xmin, xmax, ymin, ymax ) )
+         --x0;
+      while ( x1 < width && Inside( x1, y, xmin, xmax, ymin, ymax ) )
+         ++x1;
+   }
+}
+
+bool WarpTransform::Inside( int x, int y, double xmin, double xmax, double ymin, double ymax ) const
+{
+   double sx, sy, rw;
+   if ( m_affine )
+      Row<false>( &sx, &sy, x, y, 1 );
+   else
+   {
+      Row<true>( &sx, &sy, x, y, 1, &rw );
+      if ( !(rw > 0) )
+         return false;
+   }
+   return sx >= xmin && sx < xmax && sy >= ymin && sy < ymax;
+}
+
+// ----------------------------------------------------------------------------
+
+int WarpTileSize( const Matrix& H, int taps, int bytesPerPixel, double minRotation )
+{
+   // Source displacements of a step along an output row (ax,ay) and column (bx,by).
+   const double h22 = H[2][2];
+   const double ax = H[0][0]/h22, ay = H[1][0]/h22;
+   const double bx = H[0][1]/h22, by = H[1][1]/h22;
+   const double r = Sqrt( ax*ax + ay*ay );
+   // Half turns (meridian flips) read source rows backwards, which is fine.
+   if ( !(r > 0) || Abs( ay ) <= r*Sin( Rad( minRotation ) ) )
+      return 0;
+
+   // Bounding box of the footprint of a tile of side t: t*scale + taps.
+   const double scale = Max( Abs( ax ) + Abs( bx ), Abs( ay ) + Abs( by ) );
+   const double side = Sqrt( double( WarpTileCacheSize )/Max( 1, bytesPerPixel ) ) - taps;
+   return Max( 16, TruncInt( Min( side/scale, double( int_max ) ) ) );
+}
+
+// ----------------------------------------------------------------------------
+
+class WarpBandThread : public Thread
+{
+public:
+
+   WarpBandThread( WarpBandTask& task, int y0, int y1 ) : m_task( task ), m_y0( y0 ), m_y1( y1 )
+   {
+   }
+
+   virtual void Run()
+   {
+      try
+      {
+         m_task.Run( m_y0, m_y1 );
+      }
+      catch ( ... )
+      {
+         m_error = std::current_exception();
+      }
+   }
+
+   // Rethrows the exception thrown by the band, if any.
+   void Check() const
+   {
+      if ( m_error )
+         std::rethrow_exception( m_error );
+   }
+
+private:
+
+   WarpBandTask&      m_task;
+   int                m_y0, m_y1;
+   std::exception_ptr m_error;
+};
+
+bool RunWarpBands( WarpBandTask& task, int rows, int numberOfThreads, int align )
+{
+   align = Max( 1, align );
+   if ( WarpThreadPool::Active() != 0 )
+      return WarpThreadPool::Active()->Run( task, rows, align );
+
+   // At least 16 rows per band to keep thread overhead negligible.
+   numberOfThreads = Range( numberOfThreads, 1, Max( 1, rows/Max( 16, align ) ) );
+
+   if ( numberOfThreads == 1 )
+   {
+      task.SetDirect( true );
+      try
+      {
+         task.Run( 0, rows );
+      }
+      catch ( ... )
+      {
+         task.SetDirect( false );
+         throw;
+      }
+      task.SetDirect( false );
+   }
+   else
+   {
+      IndirectArray<WarpBandThread> threads;
+      int rowsPerThread = rows/numberOfThreads/align*align;
+      for ( int i = 0, j = 1; i < numberOfThreads; ++i, ++j )
+         threads.Add( new WarpBandThread( task, i*rowsPerThread, (j < numberOfThreads) ? j*rowsPerThread : rows ) );
+      /*
+       * No processor affinity here: the calling CAThread and its siblings
+       * already own the processor slots assigned by ExecuteGlobal().
+       */
+      for ( int i = 0; i < numberOfThreads; ++i )
+         threads[i]->Start( ThreadPriority::DefaultMax );
+      // The monitor is updated from this thread while the bands run.
+      for ( int i = 0; i < numberOfThreads; )
+         if ( threads[i]->Wait( WarpPollInterval ) )
+            ++i;
+         else
+            task.Poll();
+      task.Poll();
+      for ( int i = 0; i < numberOfThreads; ++i )
+         threads[i]->Check();
+      threads.Destroy();
+   }
+
+   return !task.IsAborted();
+}
+
+// ----------------------------------------------------------------------------
+
+static WarpThreadPool* s_activePool = 0;
+
+WarpThreadPool::WarpThreadPool( int numberOfThreads ) :
+m_size( Max( 1, numberOfThreads ) ), m_stop( false )
+{
+   if ( s_activePool != 0 )
+      throw Error( "Internal error: a warp thread pool is already active." );
+   m_concurrency.Store( 1 );
+   // The thread calling RunWarpBands() runs bands too.
+   for ( int i = 1; i < m_size; ++i )
+      m_workers.Add( new Worker( *this ) );
+   for ( size_type i = 0; i < m_workers.Length(); ++i )
+      m_workers[i]->Start( ThreadPriority::DefaultMax );
+   s_activePool = this;
+}
+
+WarpThreadPool::~WarpThreadPool()
+{
+   s_activePool = 0;
+   {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_stop = true;
+   }
+   m_work.notify_all();
+   for ( size_type i = 0; i < m_workers.Length(); ++i )
+      m_workers[i]->Wait();
+   m_workers.Destroy();
+}
+
+WarpThreadPool* WarpThreadPool::Active()
+{
+   return s_activePool;
+}
+
+void WarpThreadPool::SetConcurrency( int n )
+{
+   {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_concurrency.Store( Max( 1, n ) );
+   }
+   // A larger share may let more workers join the running warps.
+   m_work.notify_all();
+}
+
+bool WarpThreadPool::Run( WarpBandTask& task, int rows, int align )
+{
+   // Several bands per thread, so that workers joining late still find work,
+   // and at least 16 rows per band to keep dispatch overhead negligible.
+   const int band = Max( 16, rows/(4*m_size) );
+   Job job( task, rows, (band + align - 1)/align*align );
+   {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_jobs.Add( &job );
+   }
+   m_work.notify_all();
+
+   try
+   {
+      for ( int y0, y1; Dispatch( job, y0, y1 ); )
+      {
+         task.Run( y0, y1 );
+         Done( job, false, std::exception_ptr() );
+         task.Poll();
+      }
+   }
+   catch ( ... )
+   {
+      // No more bands for the workers; wait for those they are running.
+      {
+         std::lock_guard<std::mutex> lock( m_mutex );
+         job.next = job.rows;
+         m_jobs.Remove( &job );
+         --job.pending;
+      }
+      Wait( job );
+      throw;
+   }
+
+   Wait( job );
+   if ( job.error )
+      std::rethrow_exception( job.error );
+   return !task.IsAborted();
+}
+
+/*
+ * Takes the next band of the job, if any. Called by the thread that runs the
+ * job, which removes it from the pool once all of its bands are taken or the
+ * task has been aborted.
+ */
+bool WarpThreadPool::Dispatch( Job& job, int& y0, int& y1 )
+{
+   std::lock_guard<std::mutex> lock( m_mutex );
+   bool taken = job.next < job.rows && !job.task.IsAborted();
+   if ( taken )
+   {
+      y0 = job.next;
+      y1 = job.next = Min( job.next + job.band, job.rows );
+      ++job.pending;
+   }
+   else
+      m_jobs.Remove( &job );
+   return taken;
+}
+
+/*
+ * Takes a band for a worker from the first job with pending bands and room
+ * for another helper. Called with the pool mutex locked.
+ */
+WarpThreadPool::Job* WarpThreadPool::Next( int& y0, int& y1 )
+{
+   const int share = Share();
+   for ( size_type i = 0; i < m_jobs.Length(); ++i )
+   {
+      Job* job = m_jobs[i];
+      if ( job->next < job->rows && job->helpers + 1 < share && !job->task.IsAborted() )
+      {
+         y0 = job->next;
+         y1 = job->next = Min( job->next + job->band, job->rows );
+         ++job->pending;
+         ++job->helpers;
+         return job;
+      }
+   }
+   return 0;
+}
+
+void WarpThreadPool::Done( Job& job, bool helper, std::exception_ptr error )
+{
+   {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      --job.pending;
+      if ( helper )
+         --job.helpers;
+      if ( error && !job.error )
+         job.error = error;
+   }
+   m_done.notify_all();
+   if ( helper )
+      m_work.notify_one();
+}
+
+/*
+ * Waits for the bands of the job taken by the workers, passing their
+ * progress to the monitor of the task from this thread.
+ */
+void WarpThreadPool::Wait( Job& job )
+{
+   std::unique_lock<std::mutex> lock( m_mutex );
+   while ( job.pending > 0 )
+   {
+      m_done.wait_for( lock, std::chrono::milliseconds( int( WarpPollInterval ) ) );
+      lock.unlock();
+      job.task.Poll();
+      lock.lock();
+   }
+}
+
+void WarpThreadPool::Work()
+{
+   std::unique_lock<std::mutex> lock( m_mutex );
+   for ( ;; )
+   {
+      Job* job = 0;
+      int y0, y1;
+      while ( !m_stop && (job = Next( y0, y1 )) == 0 )
+         m_work.wait( lock );
+      if ( m_stop )
+         break;
+      lock.unlock();
+
+      std::exception_ptr error;
+      try
+      {
+         job->task.Run( y0, y1 );
+      }
+      catch ( ... )
+      {
+         error = std::current_exception();
+      }
+      Done( *job, true, error );
+
+      lock.lock();
+   }
+}
+
+void MultiWarpTask::Run( int y0, int y1 )
+{
+   for ( int b0 = y0; b0 < y1; b0 += BlockRows )
+   {
+      const int b1 = Min( b0 + BlockRows, y1 );
+      for ( size_type i = 0; i < m_tasks.Length(); ++i )
+      {
+         const int t1 = Min( b1, m_rows[i] );
+         if ( b0 < t1 )
+            m_tasks[i]->Run( b0, t1 );
+      }
+      if ( !RowDone( b1-1 ) )
+         return;
+   }
+}
+
+// ----------------------------------------------------------------------------
+
+template <class P, class F>
+static void SelectFunctions( WarpFunctions<P>& f )
+{
+   f.translation = NewTranslationTask<P, F>;
+   f.affine = NewKernelWarpTask<P, F, false>;
+   f.projective = NewKernelWarpTask<P, F, true>;
+}
+
+template <class F>
+void WarpEngine::Select()
+{
+   SelectFunctions<FloatPixelTraits, F>( m_float );
+   SelectFunctions<DoublePixelTraits, F>( m_double );
+   SelectFunctions<UInt8PixelTraits, F>( m_uint8 );
+   SelectFunctions<UInt16PixelTraits, F>( m_uint16 );
+   SelectFunctions<UInt32PixelTraits, F>( m_uint32 );
+}
+
+template <int N>
+void WarpEngine::SelectLanczos( int clampMode )
+{
+   if ( clampMode == WarpKernel::LanczosClamp )
+      Select<WarpFilter<N, WarpKernel::LanczosClamp> >();
+   else
+      Select<WarpFilter<N, WarpKernel::NoClamp> >();
+}
+
+// Kernel of the Fourier shift mode, for transformations other than translations.
+static pcl_enum KernelInterpolation( pcl_enum interpolation )
+{
+   return (interpolation == CAPixelInterpolation::FourierShift) ? pcl_enum( CAPixelInterpolation::Lanczos3 ) : interpolation;
+}
+
+WarpEngine::WarpEngine( pcl_enum interpolation, float clampingThreshold, double shiftTolerance ) :
+m_kernel( KernelInterpolation( interpolation ), clampingThreshold, false ),
+m_lutKernel( KernelInterpolation( interpolation ), clampingThreshold, true ),
+m_shiftTolerance( shiftTolerance ), m_fourier( interpolation == CAPixelInterpolation::FourierShift )
+{
+   switch ( m_kernel.Taps() )
+   {
+   case 2: // nearest neighbor, bilinear
+      Select<WarpFilter<2, WarpKernel::NoClamp> >();
+      break;
+   default:
+   case 4: // cubic filters
+      if ( m_kernel.ClampMode() == WarpKernel::SplineClamp )
+         Select<WarpFilter<4, WarpKernel::SplineClamp> >();
+      else
+         Select<WarpFilter<4, WarpKernel::NoClamp> >();
+      break;
+   case 6: // Lanczos-3
+      SelectLanczos<6>( m_kernel.ClampMode() );
+      break;
+   case 8: // Lanczos-4
+      SelectLanczos<8>( m_kernel.ClampMode() );
+      break;
+   case 10: // Lanczos-5
+      SelectLanczos<10>( m_kernel.ClampMode() );
+      break;
+   }
+}
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+// ****************************************************************************
+// EOF WarpEngine.cpp - Released 2015/03/04 19:50:08 UTC
@@ -0,0 +1,2063 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// WarpEngine.h - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#ifndef __WarpEngine_h
+#define __WarpEngine_h
+
+#include <pcl/AtomicInt.h>
+#include <pcl/Image.h>
+#include <pcl/Matrix.h>
+#include <pcl/Mutex.h>
+#include <pcl/Thread.h>
+#include <pcl/Utility.h>
+
+#include <string.h> // memmove()
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <new>
+
+#include "CometAlignmentParameters.h"
+#include "FourierShift.h"
+#include "WarpSIMD.h"
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Receives progress notifications from the warp loops. RowDone() is called
+ * after each output row has been generated; returning false aborts the warp.
+ */
+class WarpMonitor
+{
+public:
+
+   virtual ~WarpMonitor()
+   {
+   }
+
+   virtual bool RowDone( int y ) = 0;
+};
+
+/*
+ * Receives the rows of a streamed warp, see WarpEngine::Stream(). Row() is
+ * called once for each output row y, with one pointer per channel to samples
+ * that are only valid during the call. Distinct rows may be received
+ * concurrently from different threads.
+ */
+template <class P>
+class WarpRowSink
+{
+public:
+
+   virtual ~WarpRowSink()
+   {
+   }
+
+   virtual void Row( int y, const typename P::sample* const* row ) = 0;
+};
+
+/*
+ * Destination of a warp: either an output image, or a sink that receives each
+ * output row as soon as it has been generated. In the latter case every band
+ * generates its rows in a buffer of BufferLength() samples, so no output
+ * image is ever allocated.
+ *
+ * The output geometry is independent of the source image: output pixel
+ * coordinates are mapped to source coordinates by the warp matrix, so a
+ * translated matrix generates any rectangular crop of the warped image.
+ */
+template <class P>
+class WarpOutput
+{
+public:
+
+   WarpOutput( GenericImage<P>& image ) :
+   m_image( &image ), m_sink( 0 ), m_width( image.Width() ), m_height( image.Height() )
+   {
+   }
+
+   WarpOutput( WarpRowSink<P>& sink, int width, int height ) :
+   m_image( 0 ), m_sink( &sink ), m_width( width ), m_height( height )
+   {
+   }
+
+   int Width() const
+   {
+      return m_width;
+   }
+
+   int Height() const
+   {
+      return m_height;
+   }
+
+   size_type BufferLength( int numberOfChannels ) const
+   {
+      return (m_sink != 0) ? size_type( numberOfChannels )*m_width : size_type( 0 );
+   }
+
+   typename P::sample* Row( typename P::sample* buffer, int y, int c ) const
+   {
+      if ( m_sink != 0 )
+         return buffer + size_type( c )*m_width;
+      return m_image->PixelData( c ) + size_type( y )*m_width;
+   }
+
+   void Flush( int y, typename P::sample* const* row ) const
+   {
+      if ( m_sink != 0 )
+         m_sink->Row( y, row );
+   }
+
+private:
+
+   GenericImage<P>*  m_image;
+   WarpRowSink<P>*   m_sink;
+   int               m_width, m_height;
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * One-dimensional, separable equivalent of the pixel interpolation selected
+ * with a CAPixelInterpolation mode.
+ *
+ * A sample at the real coordinate x = x0 + dx (x0 = Floor( x )) is generated
+ * from Taps() consecutive source samples, starting at x0 + Origin(), with the
+ * weights computed by Weights( w, dx ). Clamping (bicubic spline and Lanczos)
+ * is applied by operator()() on each one-dimensional pass, which is how the
+ * PCL interpolations apply it on rows and columns.
+ */
+class WarpKernel
+{
+public:
+
+   enum { MaxTaps = 10 };
+
+   /*
+    * Resolution of the weight lookup tables, in entries per pixel. Table
+    * values are linearly interpolated, which keeps the weight errors below
+    * 1.0e-07, well under the resolution of 16-bit and 32-bit float data.
+    */
+   enum { LUTResolution = 4096 };
+
+   /*
+    * With lut = true, Lanczos weights are read from a precomputed table
+    * instead of evaluating sin() for each tap, and the weights of the cubic
+    * kernels (bicubic spline, B-spline, Mitchell-Netravali and Catmull-Rom)
+    * from a table of the four weights of each fractional phase.
+    */
+   WarpKernel( pcl_enum interpolation, float clampingThreshold, bool lut = false );
+
+   int Taps() const
+   {
+      return m_taps;
+   }
+
+   int Origin() const
+   {
+      return 1 - (m_taps >> 1);
+   }
+
+   void Weights( double* w, double dx ) const;
+
+   template <typename T>
+   double operator()( const T* f, const double* w ) const
+   {
+      return Combine( f, w, m_taps, m_clampMode, m_clamp );
+   }
+
+   enum { NoClamp, SplineClamp, LanczosClamp };
+
+   pcl_enum Interpolation() const
+   {
+      return m_interpolation;
+   }
+
+   int ClampMode() const
+   {
+      return m_clampMode;
+   }
+
+   double ClampingThreshold() const
+   {
+      return m_clamp;
+   }
+
+   /*
+    * True if the kernel reproduces the source samples at integer
+    * coordinates. B-spline and Mitchell-Netravali kernels are smoothing
+    * filters, even for whole-pixel shifts.
+    */
+   bool IsInterpolating() const
+   {
+      return m_interpolating;
+   }
+
+   /*
+    * Weighted sum of n samples with the clamping rule of clampMode.
+    */
+   template <typename T, typename W>
+   static double Combine( const T* f, const W* w, int n, int clampMode, double clamp )
+   {
+      switch ( clampMode )
+      {
+      case SplineClamp:
+         {
+            double f12 = f[1]*w[1] + f[2]*w[2];
+            double f03 = f[0]*w[0] + f[3]*w[3];
+            return (-f03 < f12*clamp) ? f12 + f03 : f12/(w[1] + w[2]);
+         }
+      case LanczosClamp:
+         {
+            double sp = 0, sn = 0, wp = 0;
+            for ( int k = 0; k < n; ++k )
+            {
+               double s = f[k]*w[k];
+               if ( w[k] < 0 )
+                  sn -= s;
+               else
+               {
+                  sp += s;
+                  wp += w[k];
+               }
+            }
+            return (sn < clamp*sp) ? sp - sn : sp/wp;
+         }
+      default:
+         {
+            double s = 0;
+            for ( int k = 0; k < n; ++k )
+               s += f[k]*w[k];
+            return s;
+         }
+      }
+   }
+
+private:
+
+   pcl_enum m_interpolation;
+   int      m_taps;
+   int      m_clampMode;
+   double   m_clamp;
+   double   m_B, m_C; // Mitchell-Netravali cubic filter parameters
+   bool     m_interpolating;
+   Array<double> m_lut; // Lanczos function at LUTResolution steps, or cubic weights by phase, if used
+
+   double LanczosLUT( double x ) const
+   {
+      double t = Abs( x )*LUTResolution;
+      int i = TruncInt( t );
+      if ( i >= int( m_lut.Length() ) - 1 )
+         return 0;
+      return m_lut[i] + (t - i)*(m_lut[i+1] - m_lut[i]);
+   }
+};
+
+/*
+ * Compile-time form of the combination step of a WarpKernel with N taps and
+ * the clamping rule Clamp. Warp loops instantiated with a WarpFilter have
+ * constant trip counts and no clamping switch, so they can be fully inlined
+ * and unrolled by the compiler.
+ */
+template <int N, int Clamp>
+struct WarpFilter
+{
+   enum { Taps = N };
+
+   template <typename T, typename W>
+   static double Apply( const T* f, const W* w, double clamp )
+   {
+      return WarpKernel::Combine( f, w, N, Clamp, clamp );
+   }
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if the homography M is a pure translation.
+ */
+bool IsTranslationMatrix( const Matrix& M );
+
+/*
+ * Returns true if the homography M is an affine transformation
+ * (M[2][0] == M[2][1] == 0).
+ */
+bool IsAffineMatrix( const Matrix& M );
+
+/*
+ * Conversion of an interpolated value to a sample, rounded and constrained to
+ * the representable range for integer images.
+ */
+template <class P> inline
+typename P::sample WarpSample( double v )
+{
+   if ( P::IsFloatSample() )
+      return typename P::sample( v );
+   return P::FloatToSample( Range( v, 0.0, double( P::MaxSampleValue() ) ) );
+}
+
+/*
+ * Sink writing streamed rows to an image.
+ */
+template <class P>
+class WarpImageSink : public WarpRowSink<P>
+{
+public:
+
+   WarpImageSink( GenericImage<P>& image ) : m_image( image )
+   {
+   }
+
+   virtual void Row( int y, const typename P::sample* const* row )
+   {
+      const int w = m_image.Width();
+      for ( int c = 0; c < m_image.NumberOfChannels(); ++c )
+      {
+         typename P::sample* d = m_image.PixelData( c ) + size_type( y )*w;
+         for ( int x = 0; x < w; ++x )
+            d[x] = row[c][x];
+      }
+   }
+
+private:
+
+   GenericImage<P>& m_image;
+};
+
+/*
+ * Binning stage of a streamed warp, see WarpEngine::StreamBinned(). Receives
+ * the rows of a warp generated with binning x binning subsamples per output
+ * pixel, and passes each binned row, the mean of its subsamples, to the sink
+ * as soon as its last subsample row has been received.
+ *
+ * The subsample rows of a binned row must be received in order from a single
+ * thread, as they are from bands starting at multiples of binning rows. Each
+ * binned row is accumulated in a slot taken from a pool at its first
+ * subsample row and returned after it has been flushed, so the lock is only
+ * taken twice per binned row, and nothing is allocated once there is a slot
+ * for each band running concurrently.
+ */
+template <class P>
+class WarpBinning : public WarpRowSink<P>
+{
+public:
+
+   WarpBinning( WarpRowSink<P>& sink, int width, int height, int numberOfChannels, int binning ) :
+   m_sink( sink ), m_width( width ), m_channels( numberOfChannels ), m_binning( binning ),
+   m_pending( height, (Slot*)0 )
+   {
+   }
+
+   virtual ~WarpBinning()
+   {
+      m_slots.Destroy();
+   }
+
+   virtual void Row( int y, const typename P::sample* const* row )
+   {
+      const int by = y/m_binning;
+      if ( by >= int( m_pending.Length() ) )
+         return;
+
+      if ( y%m_binning == 0 )
+         m_pending[by] = Acquire();
+      Slot* s = m_pending[by];
+      for ( int c = 0; c < m_channels; ++c )
+      {
+         double* a = s->sum.Begin() + size_type( c )*m_width;
+         const typename P::sample* r = row[c];
+         for ( int x = 0, k = 0; x < m_width; ++x )
+            for ( int i = 0; i < m_binning; ++i, ++k )
+               a[x] += r[k];
+      }
+
+      if ( y%m_binning == m_binning - 1 )
+      {
+         const double k = 1.0/m_binning/m_binning;
+         for ( size_type i = 0; i < s->sum.Length(); ++i )
+            s->out[i] = WarpSample<P>( k*s->sum[i] );
+         m_sink.Row( by, s->rows.Begin() );
+         m_pending[by] = 0;
+         Release( s );
+      }
+   }
+
+private:
+
+   // Sums of a binned row and its output buffer, channels x width samples.
+   struct Slot
+   {
+      Array<double>              sum;
+      Array<typename P::sample>  out;
+      Array<typename P::sample*> rows;
+   };
+
+   WarpRowSink<P>&     m_sink;
+   int                 m_width, m_channels, m_binning;
+   Array<Slot*>        m_pending; // slot of each binned row being accumulated
+   IndirectArray<Slot> m_slots;   // all slots
+   Array<Slot*>        m_idle;    // slots not in use
+   Mutex               m_mutex;
+
+   Slot* Acquire()
+   {
+      Slot* s;
+      m_mutex.Lock();
+      if ( m_idle.IsEmpty() )
+      {
+         m_slots.Add( s = new Slot );
+         s->sum = Array<double>( size_type( m_channels )*m_width );
+         s->out = Array<typename P::sample>( size_type( m_channels )*m_width );
+         s->rows = Array<typename P::sample*>( size_type( m_channels ) );
+         for ( int c = 0; c < m_channels; ++c )
+            s->rows[c] = s->out.Begin() + size_type( c )*m_width;
+      }
+      else
+      {
+         s = m_idle[m_idle.Length() - 1];
+         m_idle.Remove( m_idle.End() - 1 );
+      }
+      m_mutex.Unlock();
+      s->sum.Fill( 0.0 );
+      return s;
+   }
+
+   void Release( Slot* s )
+   {
+      m_mutex.Lock();
+      m_idle.Add( s );
+      m_mutex.Unlock();
+   }
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Row-wise coordinate generator for a general homography H, mapping output
+ * pixel coordinates to source image coordinates.
+ *
+ * Along an output row the homogeneous coordinates (X,Y,W) are linear in x, so
+ * they are generated from the row origin (x = 0) plus x times the constant
+ * column increments (H[0][0],H[1][0],H[2][0]). This form has no loop-carried
+ * dependency, so the compiler vectorizes it, and the coordinates of a pixel
+ * don't depend on where the generated run of pixels starts. The perspective
+ * divide is done as a separate pass over the row computing 1/W, and is
+ * skipped altogether for affine matrices (H[2][0] == H[2][1] == 0), where W is
+ * constant.
+ */
+class WarpTransform
+{
+public:
+
+   WarpTransform( const Matrix& H );
+
+   bool IsAffine() const
+   {
+      return m_affine;
+   }
+
+   /*
+    * Source coordinates of the n output pixels (x0,y) ... (x0+n-1,y). The
+    * Projective argument selects the perspective divide at compile time; it
+    * must be equal to !IsAffine(). The optional rw buffer receives 1/W for
+    * projective matrices; if it is not provided, sx is used as scratch space.
+    */
+   template <bool Projective>
+   void Row( double* sx, double* sy, int x0, int y, int n, double* rw = 0 ) const
+   {
+      const double X0 = m_H[1]*y + m_H[2];
+      const double Y0 = m_H[4]*y + m_H[5];
+      const double dX = m_H[0];
+      const double dY = m_H[3];
+
+      if ( !Projective )
+      {
+         for ( int k = 0; k < n; ++k )
+         {
+            const double x = x0 + k;
+            sx[k] = X0 + x*dX;
+            sy[k] = Y0 + x*dY;
+         }
+      }
+      else
+      {
+         const double W0 = m_H[7]*y + m_H[8];
+         const double dW = m_H[6];
+         double* r = (rw != 0) ? rw : sx;
+         for ( int k = 0; k < n; ++k )
+            r[k] = 1/(W0 + double( x0 + k )*dW);
+         for ( int k = 0; k < n; ++k )
+            sy[k] = (Y0 + double( x0 + k )*dY)*r[k];
+         for ( int k = 0; k < n; ++k )
+            sx[k] = (X0 + double( x0 + k )*dX)*r[k];
+      }
+   }
+
+   /*
+    * Span [x0,x1) of the output pixels of row y, 0 <= x0 <= x1 <= width, whose
+    * source coordinates lie in the box xmin <= X < xmax, ymin <= Y < ymax.
+    *
+    * The span is solved analytically from the linear inequalities satisfied
+    * by the homogeneous coordinates, then its ends are adjusted against the
+    * coordinates generated by Row(), so both agree on every pixel. Points with
+    * W <= 0, beyond the horizon line of a projective matrix, are excluded.
+    */
+   void Span( int& x0, int& x1, int y, int width, double xmin, double xmax, double ymin, double ymax ) const;
+
+private:
+
+   double m_H[ 9 ]; // normalized so that H[2][2] == 1
+   bool   m_affine;
+
+   bool Inside( int x, int y, double xmin, double xmax, double ymin, double ymax ) const;
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Intra-frame parallelism. A warp is split into bands of output rows, each
+ * band being generated by its own thread.
+ *
+ * The monitor belongs to the thread that runs the warp, so it is only called
+ * from that thread: the bands record their progress with RowDone(), and the
+ * dispatching thread passes it to the monitor with Poll(), between its own
+ * bands and while it waits for the others. An abort request from the monitor
+ * stops every band at its next row. A task run by a single band on the
+ * calling thread polls the monitor at every row.
+ */
+class WarpBandTask
+{
+public:
+
+   WarpBandTask( WarpMonitor* monitor ) : m_monitor( monitor ), m_aborted( false ), m_direct( false )
+   {
+      m_row.Store( -1 );
+   }
+
+   virtual ~WarpBandTask()
+   {
+   }
+
+   virtual void Run( int y0, int y1 ) = 0;
+
+   // Called by the bands after each row; false once aborted.
+   bool RowDone( int y )
+   {
+      m_row.Store( y );
+      if ( m_direct )
+         return Poll();
+      return !m_aborted;
+   }
+
+   // Called by the dispatching thread only.
+   bool Poll()
+   {
+      if ( !m_aborted && m_monitor != 0 )
+      {
+         int y = m_row.Load();
+         if ( y >= 0 && !m_monitor->RowDone( y ) )
+            m_aborted = true;
+      }
+      return !m_aborted;
+   }
+
+   bool IsAborted() const
+   {
+      return m_aborted;
+   }
+
+   // True while the task runs on the dispatching thread alone.
+   void SetDirect( bool direct )
+   {
+      m_direct = direct;
+   }
+
+private:
+
+   WarpMonitor*  m_monitor;
+   AtomicInt     m_row;     // last row reported by a band
+   volatile bool m_aborted;
+   bool          m_direct;
+};
+
+/*
+ * Interval of the progress updates of a thread waiting for the bands of its
+ * warp, in milliseconds.
+ */
+enum { WarpPollInterval = 100 };
+
+/*
+ * Runs task over the rows [0,rows) using up to numberOfThreads concurrent
+ * bands, each of them starting at a multiple of align rows. Returns false if
+ * the task has been aborted.
+ *
+ * While a WarpThreadPool is active, the bands are run by the calling thread
+ * and the workers of the pool, and numberOfThreads is superseded by the
+ * share of the pool, which is evaluated again at each band.
+ *
+ * An exception thrown by a band is rethrown in the calling thread once the
+ * running bands have finished.
+ */
+bool RunWarpBands( WarpBandTask& task, int rows, int numberOfThreads, int align = 1 );
+
+/*
+ * Worker threads shared by the warps of all the frames of a process
+ * execution, so that no threads are created for each warp.
+ *
+ * RunWarpBands() splits a warp into several bands per thread of the pool. The
+ * calling thread runs the bands of its own warp, while idle workers take the
+ * pending bands of the running warps, one band at a time. Each warp may use
+ * the calling thread plus Share() - 1 workers. The share is checked at each
+ * band dispatch, so a warp gets more threads as soon as other frames finish.
+ * Idle workers, and threads waiting for the bands of their warps, block on
+ * condition variables signaled as jobs are added and bands finish.
+ *
+ * A pool is active from its construction to its destruction, both in the
+ * same thread and while no warp is running. Only one pool can be active.
+ */
+class WarpThreadPool
+{
+public:
+
+   WarpThreadPool( int numberOfThreads );
+
+   ~WarpThreadPool();
+
+   // The active pool, or zero.
+   static WarpThreadPool* Active();
+
+   // Number of frames processed concurrently, each of them running its warps.
+   void SetConcurrency( int n );
+
+   // Threads available to each warp, its calling thread included.
+   int Share() const
+   {
+      return Max( 1, m_size/Max( 1, m_concurrency.Load() ) );
+   }
+
+   bool Run( WarpBandTask& task, int rows, int align );
+
+private:
+
+   // Pending bands of a running warp, [next,rows) in bands of band rows.
+   struct Job
+   {
+      WarpBandTask&      task;
+      int                rows, band, next;
+      int                helpers; // workers running bands of the job
+      int                pending; // bands taken and not finished yet
+      std::exception_ptr error;   // first exception thrown by a worker band
+
+      Job( WarpBandTask& t, int r, int b ) :
+      task( t ), rows( r ), band( b ), next( 0 ), helpers( 0 ), pending( 0 )
+      {
+      }
+   };
+
+   class Worker : public Thread
+   {
+   public:
+
+      Worker( WarpThreadPool& pool ) : m_pool( pool )
+      {
+      }
+
+      virtual void Run()
+      {
+         m_pool.Work();
+      }
+
+   private:
+
+      WarpThreadPool& m_pool;
+   };
+
+   int                     m_size;
+   mutable AtomicInt       m_concurrency;
+   std::mutex              m_mutex;
+   std::condition_variable m_work;    // signaled when bands may be taken by workers
+   std::condition_variable m_done;    // signaled when bands are finished
+   Array<Job*>             m_jobs;
+   IndirectArray<Worker>   m_workers;
+   bool                    m_stop;
+
+   bool Dispatch( Job& job, int& y0, int& y1 );
+   Job* Next( int& y0, int& y1 );
+   void Done( Job& job, bool helper, std::exception_ptr error );
+   void Wait( Job& job );
+   void Work();
+
+   // Not copyable: the workers refer to the pool.
+   WarpThreadPool( const WarpThreadPool& );
+   void operator =( const WarpThreadPool& );
+};
+
+/*
+ * Several warps of the same source image in a single sweep. The tasks, which
+ * must have no monitor, generate their outputs of rows[i] rows in interleaved
+ * blocks of BlockRows rows: a block of source rows read by the first task is
+ * still in cache when the next tasks read it, as long as their
+ * transformations are close, such as the star and comet alignments of a
+ * frame. Progress is notified to the monitor once per block. The tasks are
+ * owned by the caller.
+ */
+class MultiWarpTask : public WarpBandTask
+{
+public:
+
+   enum { BlockRows = 32 };
+
+   MultiWarpTask( const Array<WarpBandTask*>& tasks, const Array<int>& rows, WarpMonitor* monitor ) :
+   WarpBandTask( monitor ), m_tasks( tasks ), m_rows( rows )
+   {
+   }
+
+   virtual void Run( int y0, int y1 );
+
+private:
+
+   Array<WarpBandTask*> m_tasks;
+   Array<int>           m_rows;
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Translation engine.
+ *
+ * Every pixel of a translated image shares the same sub-pixel phase, so the
+ * kernel weights are computed once per image and the interpolation is applied
+ * with the filter F as a horizontal pass followed by a vertical pass.
+ * Horizontally interpolated rows are kept in a small ring buffer, so each
+ * source row is visited once per band.
+ *
+ * The output pixel (x,y) receives the source value at (x+dx,y+dy); pixels
+ * mapped outside the source image, a band of rows and columns known in
+ * advance, are set to zero.
+ */
+template <class P, class F>
+class TranslationTask : public WarpBandTask
+{
+public:
+
+   TranslationTask( const WarpOutput<P>& output, const GenericImage<P>& image, double dx, double dy,
+                    const WarpKernel& K, WarpMonitor* monitor ) :
+   WarpBandTask( monitor ), m_output( output ), m_image( image ), m_clamp( K.ClampingThreshold() )
+   {
+      const int w = m_image.Width();
+      const int h = m_image.Height();
+      const int ix = TruncInt( Floor( dx ) );
+      const int iy = TruncInt( Floor( dy ) );
+      K.Weights( m_wx, dx - ix );
+      K.Weights( m_wy, dy - iy );
+      m_ox = ix + K.Origin();
+      m_oy = iy + K.Origin();
+
+      // Output region mapped inside the source image: 0 <= x+dx < w
+      m_x0 = Range( TruncInt( Ceil( -dx ) ), 0, m_output.Width() );
+      m_x1 = Range( TruncInt( Ceil( w - dx ) ), m_x0, m_output.Width() );
+      m_y0 = Range( TruncInt( Ceil( -dy ) ), 0, m_output.Height() );
+      m_y1 = Range( TruncInt( Ceil( h - dy ) ), m_y0, m_output.Height() );
+   }
+
+   virtual void Run( int y0, int y1 )
+   {
+      const int w = m_image.Width();
+      const int h = m_image.Height();
+      const int ow = m_output.Width();
+      const int nc = m_image.NumberOfChannels();
+      const int n = F::Taps;
+      const int x0 = m_x0;
+      const int x1 = m_x1;
+      const int rw = x1 - x0;
+
+      // Ring buffer of horizontally interpolated source rows, n rows/channel.
+      Array<double> rows( size_type( nc )*n*Max( rw, 1 ) );
+      Array<int> rowIndex( size_type( nc )*n, -1 );
+      Array<typename P::sample> buffer( m_output.BufferLength( nc ) );
+      Array<typename P::sample*> out( nc );
+
+      for ( int y = y0; y < y1; ++y )
+      {
+         for ( int c = 0; c < nc; ++c )
+            out[c] = m_output.Row( buffer.Begin(), y, c );
+
+         if ( rw <= 0 || y < m_y0 || y >= m_y1 )
+         {
+            for ( int c = 0; c < nc; ++c )
+               Fill( out[c], out[c] + ow, typename P::sample( 0 ) );
+            m_output.Flush( y, out.Begin() );
+            if ( !RowDone( y ) )
+               return;
+            continue;
+         }
+
+         for ( int c = 0; c < nc; ++c )
+         {
+            const typename P::sample* src = m_image.PixelData( c );
+            const double* f[ WarpKernel::MaxTaps ];
+
+            for ( int k = 0; k < n; ++k )
+            {
+               int sy = Range( y + m_oy + k, 0, h-1 );
+               int slot = c*n + sy%n;
+               double* r = rows.Begin() + size_type( slot )*rw;
+               if ( rowIndex[slot] != sy )
+               {
+                  const typename P::sample* s = src + size_type( sy )*w;
+                  for ( int x = x0; x < x1; ++x )
+                  {
+                     int sx = x + m_ox;
+                     if ( sx >= 0 && sx+n <= w )
+                        r[x-x0] = F::Apply( s + sx, m_wx, m_clamp );
+                     else
+                     {
+                        double g[ WarpKernel::MaxTaps ];
+                        for ( int j = 0; j < n; ++j )
+                           g[j] = s[Range( sx + j, 0, w-1 )];
+                        r[x-x0] = F::Apply( g, m_wx, m_clamp );
+                     }
+                  }
+                  rowIndex[slot] = sy;
+               }
+               f[k] = r;
+            }
+
+            typename P::sample* dst = out[c];
+            Fill( dst, dst + x0, typename P::sample( 0 ) );
+            Fill( dst + x1, dst + ow, typename P::sample( 0 ) );
+            dst += x0;
+            for ( int x = 0; x < rw; ++x )
+            {
+               double g[ WarpKernel::MaxTaps ];
+               for ( int k = 0; k < n; ++k )
+                  g[k] = f[k][x];
+               dst[x] = WarpSample<P>( F::Apply( g, m_wy, m_clamp ) );
+            }
+         }
+
+         m_output.Flush( y, out.Begin() );
+         if ( !RowDone( y ) )
+            return;
+      }
+   }
+
+private:
+
+         WarpOutput<P>    m_output;
+   const GenericImage<P>& m_image;
+         double           m_clamp;
+         double           m_wx[ WarpKernel::MaxTaps ], m_wy[ WarpKernel::MaxTaps ];
+         int              m_ox, m_oy;
+         int              m_x0, m_x1, m_y0, m_y1;
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Output tiles of rotated transformations.
+ *
+ * A row-major warp reads the source image along the direction of the output
+ * rows. When the homography H rotates the image, that direction crosses a
+ * source row every 1/tan(angle) pixels, so on wide images each output row
+ * visits thousands of source rows and consecutive rows miss the cache and the
+ * TLB, instead of reusing the footprint of the previous row.
+ *
+ * Returns the side of square output tiles whose source footprint, for a filter
+ * of the specified number of taps and pixels of bytesPerPixel bytes (all
+ * channels), fits in WarpTileCacheSize bytes, or zero if the rotation angle of
+ * H is smaller than minRotation degrees and the image should be traversed row
+ * by row. For projective matrices the linear part at the origin is used.
+ */
+enum { WarpTileCacheSize = 256*1024 };
+
+/*
+ * Largest buffer of pending output rows of a band of a streamed warp, in
+ * bytes. Sinks receive whole rows, so a tiled band buffers the rows of a
+ * whole row of tiles until its last tile is done.
+ */
+enum { WarpStreamBufferSize = 1024*1024 };
+
+int WarpTileSize( const Matrix& H, int taps, int bytesPerPixel, double minRotation = 1.0 );
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Portable implementation of WarpSIMDRow(), for any sample type: interpolates
+ * pixels [i0,n) of the row for all channels.
+ */
+template <typename T>
+void WarpRowScalar( float* const* out, const T* const* src, int nc, int i0, int n, const WarpRowData& row )
+{
+   const int taps = row.taps;
+   for ( int i = i0; i < n; ++i )
+   {
+      double wx[ WarpKernel::MaxTaps ], wy[ WarpKernel::MaxTaps ];
+      for ( int j = 0; j < taps; ++j )
+      {
+         wx[j] = row.wx[j*row.stride + i];
+         wy[j] = row.wy[j*row.stride + i];
+      }
+      for ( int c = 0; c < nc; ++c )
+      {
+         double r[ WarpKernel::MaxTaps ];
+         for ( int k = 0; k < taps; ++k )
+         {
+            const T* s = src[c] + row.off[i] + k*row.width;
+            double f[ WarpKernel::MaxTaps ];
+            for ( int j = 0; j < taps; ++j )
+               f[j] = s[j];
+            r[k] = WarpKernel::Combine( f, wx, taps, row.clampMode, row.clamp );
+         }
+         out[c][i] = float( WarpKernel::Combine( r, wy, taps, row.clampMode, row.clamp ) );
+      }
+   }
+}
+
+/*
+ * Working precision of the kernel warp for each sample type. Weights are
+ * stored in single precision for 8-bit, 16-bit and 32-bit float images, which
+ * also use Lanczos lookup tables, and in double precision for 32-bit integer
+ * and 64-bit float images. Only 16-bit and 32-bit float images have
+ * vectorized row kernels.
+ */
+template <class P>
+struct WarpTraits
+{
+   typedef double weight;
+   enum { LUT = false, Vectorized = false };
+};
+
+template <>
+struct WarpTraits<FloatPixelTraits>
+{
+   typedef float weight;
+   enum { LUT = true, Vectorized = true };
+};
+
+template <>
+struct WarpTraits<UInt16PixelTraits>
+{
+   typedef float weight;
+   enum { LUT = true, Vectorized = true };
+};
+
+template <>
+struct WarpTraits<UInt8PixelTraits>
+{
+   typedef float weight;
+   enum { LUT = true, Vectorized = false };
+};
+
+/*
+ * Vectorized interpolation of a row of interior pixels. Returns false if
+ * there is no vectorized implementation for the sample type.
+ */
+template <typename T> inline
+bool WarpKernelRow( float* const*, const T* const*, int, int, const WarpRowData& )
+{
+   return false;
+}
+
+inline bool WarpKernelRow( float* const* out, const float* const* src, int nc, int n, const WarpRowData& row )
+{
+   WarpSIMDRow( out, src, nc, n, row );
+   return true;
+}
+
+inline bool WarpKernelRow( float* const* out, const uint16* const* src, int nc, int n, const WarpRowData& row )
+{
+   WarpSIMDRow( out, src, nc, n, row );
+   return true;
+}
+
+/*
+ * General homography warp with the filter F. Projective selects the
+ * perspective divide of the coordinate generator.
+ *
+ * Each output row is clipped analytically before interpolation: the span of
+ * pixels mapped inside the source image and, within it, the span of pixels
+ * whose whole footprint lies inside the image are solved by
+ * WarpTransform::Span(). Pixels outside the first span are zero-filled in
+ * bulk. Interior pixels are processed without any per-pixel bounds test, by
+ * WarpSIMDRow() when the sample type is vectorized and by inlined scalar code
+ * otherwise; the remaining border pixels replicate the edge samples, as the
+ * PCL interpolators do.
+ *
+ * The kernel weights of every pixel are computed once and stored as
+ * structure-of-arrays rows. All channels are interpolated in the same pass
+ * over the row, reusing the offsets and weights of each pixel.
+ *
+ * Rotated transformations are traversed in square tiles of the size given by
+ * WarpTileSize(): the rows of each band are clipped once, then generated tile
+ * by tile, and flushed when the last tile of the band is done. When the
+ * output is streamed, those rows are buffered, so the tiles are made shorter
+ * if needed to keep the buffer within WarpStreamBufferSize bytes.
+ */
+template <class P, class F, bool Projective>
+class KernelWarpTask : public WarpBandTask
+{
+public:
+
+   typedef typename WarpTraits<P>::weight weight;
+
+   KernelWarpTask( const WarpOutput<P>& output, const GenericImage<P>& image, const Matrix& H,
+                   const WarpKernel& K, WarpMonitor* monitor ) :
+   WarpBandTask( monitor ), m_output( output ), m_image( image ), m_H( H ), m_K( K )
+   {
+      int tile = WarpTileSize( H, F::Taps, image.NumberOfChannels()*(P::BitsPerSample() >> 3) );
+      if ( tile > 0 )
+      {
+         m_tileWidth = Min( tile, m_output.Width() );
+         m_tileHeight = tile;
+         size_type rowSize = m_output.BufferLength( image.NumberOfChannels() )*sizeof( typename P::sample );
+         if ( rowSize > 0 )
+            m_tileHeight = Range( int( WarpStreamBufferSize/rowSize ), 1, tile );
+      }
+      else
+      {
+         m_tileWidth = m_output.Width();
+         m_tileHeight = 1;
+      }
+   }
+
+   virtual void Run( int y0, int y1 )
+   {
+      const int w = m_image.Width();
+      const int h = m_image.Height();
+      const int ow = m_output.Width();
+      const int nc = m_image.NumberOfChannels();
+      const int n = F::Taps;
+      const int o = m_K.Origin();
+      const double clamp = m_K.ClampingThreshold();
+      // The vector kernels address samples with 32-bit gather offsets.
+      const bool vectorized = WarpTraits<P>::Vectorized && m_image.NumberOfPixels() < size_type( int32_max );
+      // 16-bit samples are gathered as 32-bit words: keep off the last column.
+      const int guard = (vectorized && P::BitsPerSample() < 32) ? 1 : 0;
+      // Footprint origins of interior pixels, and their source coordinates.
+      const int ixMax = w - n - guard;
+      const int iyMax = h - n;
+      const double xiMin = -o, xiMax = ixMax - o + 1;
+      const double yiMin = -o, yiMax = iyMax - o + 1;
+
+      Array<double> sx( ow ), sy( ow );
+      Array<int32> xs( ow ), ixs( ow ), iys( ow ), off( ow );
+      Array<weight> wx( size_type( n )*ow ), wy( size_type( n )*ow );
+      Array<float> out( vectorized ? size_type( nc )*ow : size_type( 0 ) );
+      const size_type rowLength = m_output.BufferLength( nc );
+      Array<typename P::sample> buffer( rowLength*m_tileHeight );
+      Array<int> spans( size_type( 4 )*m_tileHeight );
+
+      Array<const typename P::sample*> src( nc );
+      Array<typename P::sample*> dst( nc );
+      Array<float*> outc( nc );
+      for ( int c = 0; c < nc; ++c )
+      {
+         src[c] = m_image.PixelData( c );
+         outc[c] = vectorized ? out.Begin() + size_type( c )*ow : 0;
+      }
+
+      WarpRowData row;
+      row.off = off.Begin();
+      SetRowWeights( row, wx.Begin(), wy.Begin() );
+      row.stride = ow;
+      row.taps = n;
+      row.width = w;
+      row.clampMode = m_K.ClampMode();
+      row.clamp = float( clamp );
+
+      for ( int ty0 = y0; ty0 < y1; ty0 += m_tileHeight )
+      {
+         const int ty1 = Min( ty0 + m_tileHeight, y1 );
+
+         // Pixels mapped inside the source image: [va,vb); interior: [ia,ib).
+         for ( int y = ty0; y < ty1; ++y )
+         {
+            int* sp = spans.Begin() + 4*(y - ty0);
+            m_H.Span( sp[0], sp[1], y, ow, 0, w, 0, h );
+            if ( sp[0] < sp[1] && ixMax >= 0 && iyMax >= 0 )
+            {
+               m_H.Span( sp[2], sp[3], y, ow, xiMin, xiMax, yiMin, yiMax );
+               sp[2] = Range( sp[2], sp[0], sp[1] );
+               sp[3] = Range( sp[3], sp[2], sp[1] );
+            }
+            else
+               sp[2] = sp[3] = sp[1];
+         }
+
+         for ( int tx0 = 0; tx0 < ow; tx0 += m_tileWidth )
+         {
+            const int tx1 = Min( tx0 + m_tileWidth, ow );
+
+            for ( int y = ty0; y < ty1; ++y )
+            {
+               for ( int c = 0; c < nc; ++c )
+                  dst[c] = m_output.Row( buffer.Begin() + (y - ty0)*rowLength, y, c );
+
+               // The spans of row y within the columns [tx0,tx1) of the tile.
+               const int* sp = spans.Begin() + 4*(y - ty0);
+               const int va = Range( sp[0], tx0, tx1 );
+               const int vb = Range( sp[1], va, tx1 );
+               const int ia = Range( sp[2], va, vb );
+               const int ib = Range( sp[3], ia, vb );
+
+               for ( int c = 0; c < nc; ++c )
+               {
+                  Fill( dst[c] + tx0, dst[c] + va, typename P::sample( 0 ) );
+                  Fill( dst[c] + vb, dst[c] + tx1, typename P::sample( 0 ) );
+               }
+
+               if ( va < vb )
+               {
+                  m_H.template Row<Projective>( sx.Begin() + va, sy.Begin() + va, va, y, vb - va );
+
+                  // Interior pixels are stored at [0,m), border pixels at [m,nb).
+                  const int m = ib - ia;
+                  for ( int i = 0; i < m; ++i )
+                  {
+                     double X = sx[ia+i], Y = sy[ia+i];
+                     int ix = TruncInt( X );
+                     int iy = TruncInt( Y );
+                     double wxd[ WarpKernel::MaxTaps ], wyd[ WarpKernel::MaxTaps ];
+                     m_K.Weights( wxd, X - ix );
+                     m_K.Weights( wyd, Y - iy );
+                     // Constrained against rounding at the span ends.
+                     ix = Range( ix + o, 0, ixMax );
+                     iy = Range( iy + o, 0, iyMax );
+                     ixs[i] = ix;
+                     iys[i] = iy;
+                     off[i] = iy*w + ix;
+                     for ( int j = 0; j < n; ++j )
+                     {
+                        wx[j*ow + i] = weight( wxd[j] );
+                        wy[j*ow + i] = weight( wyd[j] );
+                     }
+                  }
+
+                  int nb = m;
+                  for ( int part = 0; part < 2; ++part )
+                     for ( int x = part ? ib : va, x1 = part ? vb : ia; x < x1; ++x, ++nb )
+                     {
+                        double X = sx[x], Y = sy[x];
+                        int ix = TruncInt( X );
+                        int iy = TruncInt( Y );
+                        double wxd[ WarpKernel::MaxTaps ], wyd[ WarpKernel::MaxTaps ];
+                        m_K.Weights( wxd, X - ix );
+                        m_K.Weights( wyd, Y - iy );
+                        xs[nb] = x;
+                        ixs[nb] = ix + o;
+                        iys[nb] = iy + o;
+                        for ( int j = 0; j < n; ++j )
+                        {
+                           wx[j*ow + nb] = weight( wxd[j] );
+                           wy[j*ow + nb] = weight( wyd[j] );
+                        }
+                     }
+
+                  if ( vectorized && WarpKernelRow( outc.Begin(), src.Begin(), nc, m, row ) )
+                  {
+                     for ( int c = 0; c < nc; ++c )
+                     {
+                        typename P::sample* d = dst[c] + ia;
+                        const float* v = outc[c];
+                        for ( int i = 0; i < m; ++i )
+                           d[i] = WarpSample<P>( v[i] );
+                     }
+                  }
+                  else
+                  {
+                     for ( int i = 0; i < m; ++i )
+                     {
+                        weight wxe[ WarpKernel::MaxTaps ], wye[ WarpKernel::MaxTaps ];
+                        for ( int j = 0; j < n; ++j )
+                        {
+                           wxe[j] = wx[j*ow + i];
+                           wye[j] = wy[j*ow + i];
+                        }
+                        const size_type base = size_type( iys[i] )*w + ixs[i];
+                        for ( int c = 0; c < nc; ++c )
+                        {
+                           const typename P::sample* s = src[c] + base;
+                           double r[ WarpKernel::MaxTaps ];
+                           for ( int k = 0; k < n; ++k, s += w )
+                              r[k] = F::Apply( s, wxe, clamp );
+                           dst[c][ia+i] = WarpSample<P>( F::Apply( r, wye, clamp ) );
+                        }
+                     }
+                  }
+
+                  for ( int e = m; e < nb; ++e )
+                  {
+                     weight wxe[ WarpKernel::MaxTaps ], wye[ WarpKernel::MaxTaps ];
+                     size_type rows[ WarpKernel::MaxTaps ];
+                     int cols[ WarpKernel::MaxTaps ];
+                     for ( int j = 0; j < n; ++j )
+                     {
+                        wxe[j] = wx[j*ow + e];
+                        wye[j] = wy[j*ow + e];
+                        rows[j] = size_type( Range( iys[e] + j, 0, h-1 ) )*w;
+                        cols[j] = Range( ixs[e] + j, 0, w-1 );
+                     }
+                     for ( int c = 0; c < nc; ++c )
+                     {
+                        double r[ WarpKernel::MaxTaps ], g[ WarpKernel::MaxTaps ];
+                        for ( int k = 0; k < n; ++k )
+                        {
+                           const typename P::sample* s = src[c] + rows[k];
+                           for ( int j = 0; j < n; ++j )
+                              g[j] = s[cols[j]];
+                           r[k] = F::Apply( g, wxe, clamp );
+                        }
+                        dst[c][xs[e]] = WarpSample<P>( F::Apply( r, wye, clamp ) );
+                     }
+                  }
+               }
+            }
+         }
+
+         for ( int y = ty0; y < ty1; ++y )
+         {
+            for ( int c = 0; c < nc; ++c )
+               dst[c] = m_output.Row( buffer.Begin() + (y - ty0)*rowLength, y, c );
+            m_output.Flush( y, dst.Begin() );
+            if ( !RowDone( y ) )
+               return;
+         }
+      }
+   }
+
+private:
+
+         WarpOutput<P>    m_output;
+   const GenericImage<P>& m_image;
+         WarpTransform    m_H;
+   const WarpKernel&      m_K;
+         int              m_tileWidth, m_tileHeight; // w x 1 for row-major traversal
+
+   static void SetRowWeights( WarpRowData& row, const float* wx, const float* wy )
+   {
+      row.wx = wx;
+      row.wy = wy;
+   }
+
+   static void SetRowWeights( WarpRowData& row, const double*, const double* )
+   {
+      row.wx = row.wy = 0; // no vector kernels in double precision
+   }
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Whole-pixel translation, done in place: the pixel (x,y) receives the pixel
+ * (x+dx,y+dy), or zero if that lies outside the image.
+ *
+ * Each row is moved with a single memmove(). Rows are visited in the order
+ * that never overwrites a source row before it has been read, so no output
+ * image is allocated and no sample is interpolated.
+ */
+template <class P>
+void ShiftImage( GenericImage<P>& image, int dx, int dy )
+{
+   const int w = image.Width();
+   const int h = image.Height();
+   const int x0 = Range( -dx, 0, w );
+   const int x1 = Range( w - dx, x0, w );
+   const int y0 = Range( -dy, 0, h );
+   const int y1 = Range( h - dy, y0, h );
+   const int rw = x1 - x0;
+
+   for ( int c = 0; c < image.NumberOfChannels(); ++c )
+   {
+      typename P::sample* data = image.PixelData( c );
+      for ( int i = 0; i < h; ++i )
+      {
+         int y = (dy >= 0) ? i : h-1 - i;
+         typename P::sample* row = data + size_type( y )*w;
+         if ( y < y0 || y >= y1 || rw <= 0 )
+            Fill( row, row + w, typename P::sample( 0 ) );
+         else
+         {
+            ::memmove( row + x0, data + size_type( y + dy )*w + x0 + dx, size_type( rw )*sizeof( typename P::sample ) );
+            Fill( row, row + x0, typename P::sample( 0 ) );
+            Fill( row + x1, row + w, typename P::sample( 0 ) );
+         }
+      }
+   }
+}
+
+/*
+ * Streamed whole-pixel translation, the counterpart of ShiftImage() for
+ * WarpEngine::Stream(): each output row is copied from its source row into
+ * the band's row buffer.
+ */
+template <class P>
+class ShiftTask : public WarpBandTask
+{
+public:
+
+   ShiftTask( const WarpOutput<P>& output, const GenericImage<P>& image, int dx, int dy, WarpMonitor* monitor ) :
+   WarpBandTask( monitor ), m_output( output ), m_image( image ), m_dx( dx ), m_dy( dy )
+   {
+   }
+
+   virtual void Run( int y0, int y1 )
+   {
+      const int w = m_image.Width();
+      const int h = m_image.Height();
+      const int ow = m_output.Width();
+      const int nc = m_image.NumberOfChannels();
+      const int x0 = Range( -m_dx, 0, ow );
+      const int x1 = Range( w - m_dx, x0, ow );
+      Array<typename P::sample> buffer( m_output.BufferLength( nc ) );
+      Array<typename P::sample*> out( nc );
+
+      for ( int y = y0; y < y1; ++y )
+      {
+         const int sy = y + m_dy;
+         for ( int c = 0; c < nc; ++c )
+         {
+            typename P::sample* row = out[c] = m_output.Row( buffer.Begin(), y, c );
+            if ( sy < 0 || sy >= h || x0 == x1 )
+               Fill( row, row + ow, typename P::sample( 0 ) );
+            else
+            {
+               const typename P::sample* s = m_image.PixelData( c ) + size_type( sy )*w + m_dx;
+               Fill( row, row + x0, typename P::sample( 0 ) );
+               for ( int x = x0; x < x1; ++x )
+                  row[x] = s[x];
+               Fill( row + x1, row + ow, typename P::sample( 0 ) );
+            }
+         }
+
+         m_output.Flush( y, out.Begin() );
+         if ( !RowDone( y ) )
+            return;
+      }
+   }
+
+private:
+
+         WarpOutput<P>    m_output;
+   const GenericImage<P>& m_image;
+         int              m_dx, m_dy;
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Minimum margin around each plane shifted in the Fourier domain, so that the
+ * circular shift doesn't wrap opposite borders into the image.
+ */
+enum { FourierPadding = 16 };
+
+/*
+ * Fourier-domain translation: the output pixel (x,y) receives the source
+ * value at (x+dx,y+dy), or zero if that lies outside the image, as with the
+ * separable translation engine.
+ *
+ * The whole-pixel part of the shift becomes an index offset, and only the
+ * remaining fraction, at most half a pixel, is applied to the spectrum as a
+ * phase ramp. The shift is exact for band-limited data, with no kernel
+ * truncation.
+ *
+ * Each channel is copied to a padded plane, then shifted row by row and
+ * column by column, as the ramp is separable, in band passes: the rows of
+ * the image are padded and shifted, the columns that reach the output are
+ * shifted, and the output rows are written. Every pass reports progress: the
+ * row passes by rows, the column pass by output columns.
+ *
+ * Output to an image reuses a single plane for every channel. A streamed
+ * output receives all the channels of each row at once, so each channel has
+ * its own plane, and the rows are streamed from the planes in a last pass,
+ * in bands of align rows, as WarpEngine::Stream() does; no output image is
+ * allocated. The planes of a frame, of about width x height samples of type
+ * T per channel, are the one buffer of a streamed warp that is not bounded:
+ * the column pass needs whole columns. The planes belong to the task, so
+ * they are freed as soon as the image is shifted.
+ */
+template <class P>
+class FourierShiftTask : public WarpBandTask
+{
+public:
+
+   typedef typename WarpTraits<P>::weight T;
+
+   FourierShiftTask( const WarpOutput<P>& output, const GenericImage<P>& image, double dx, double dy, WarpMonitor* monitor ) :
+   WarpBandTask( monitor ), m_output( output ), m_image( image ), m_pass( RowPass ), m_channel( 0 ), m_c0( 0 ), m_c1( 0 )
+   {
+      const int w = image.Width();
+      const int h = image.Height();
+      const int ow = output.Width();
+      const int oh = output.Height();
+
+      // Output region mapped inside the source image: 0 <= x+dx < w
+      m_x0 = Range( TruncInt( Ceil( -dx ) ), 0, ow );
+      m_x1 = Range( TruncInt( Ceil( w - dx ) ), m_x0, ow );
+      m_y0 = Range( TruncInt( Ceil( -dy ) ), 0, oh );
+      m_y1 = Range( TruncInt( Ceil( h - dy ) ), m_y0, oh );
+      if ( m_x0 == m_x1 || m_y0 == m_y1 )
+         m_x0 = m_x1 = m_y0 = m_y1 = 0; // nothing to shift
+
+      const double ix = Floor( dx + 0.5 );
+      const double iy = Floor( dy + 0.5 );
+      m_fx = dx - ix;
+      m_fy = dy - iy;
+      m_ox = TruncInt( ix ) + FourierPadding;
+      m_oy = TruncInt( iy ) + FourierPadding;
+      m_rows = FourierLineShift<T>::OptimizedLength( h + 2*FourierPadding );
+      m_cols = FourierLineShift<T>::OptimizedLength( w + 2*FourierPadding );
+
+      /*
+       * The margins join the last and first columns (rows) of the image with
+       * a raised cosine, so the periodic extension of the plane is continuous
+       * and the shift doesn't ring at the borders.
+       */
+      const int gx = m_cols - w;
+      const int gy = m_rows - h;
+      m_bx = Array<double>( gx );
+      m_by = Array<double>( gy );
+      for ( int k = 0; k < gx; ++k )
+         m_bx[k] = (1 - Cos( Const<double>::pi()*(k + 1)/(gx + 1) ))/2;
+      for ( int k = 0; k < gy; ++k )
+         m_by[k] = (1 - Cos( Const<double>::pi()*(k + 1)/(gy + 1) ))/2;
+   }
+
+   /*
+    * Shifts every channel into the output on numberOfThreads band threads,
+    * streamed output rows in bands starting at multiples of align rows.
+    * Returns false if the monitor has requested an abort.
+    */
+   bool Shift( int numberOfThreads, int align = 1 )
+   {
+      const int nc = m_image.NumberOfChannels();
+      const bool streamed = m_output.BufferLength( 1 ) > 0;
+      if ( m_x0 < m_x1 )
+      {
+         try
+         {
+            m_planes = Array<Array<T> >( size_type( streamed ? nc : 1 ) );
+            for ( size_type i = 0; i < m_planes.Length(); ++i )
+               m_planes[i] = Array<T>( size_type( m_rows )*m_cols );
+         }
+         catch ( std::bad_alloc& )
+         {
+            m_planes.Clear();
+            throw Error( String().Format( "Fourier shift: insufficient memory for %d planes of %dx%d samples.",
+                                          streamed ? nc : 1, m_cols, m_rows ) );
+         }
+
+         for ( int c = 0; c < nc; ++c )
+         {
+            m_channel = c;
+            if ( !ShiftPlane( numberOfThreads ) )
+               return false;
+            if ( !streamed )
+            {
+               m_c0 = c;
+               m_c1 = c + 1;
+               m_pass = OutputPass;
+               if ( !RunWarpBands( *this, m_output.Height(), numberOfThreads ) )
+                  return false;
+            }
+         }
+         if ( !streamed )
+         {
+            m_planes.Clear();
+            return true;
+         }
+      }
+
+      m_c0 = 0;
+      m_c1 = nc;
+      m_pass = OutputPass;
+      bool done = RunWarpBands( *this, m_output.Height(), numberOfThreads, align );
+      m_planes.Clear();
+      return done;
+   }
+
+   virtual void Run( int i0, int i1 )
+   {
+      switch ( m_pass )
+      {
+      case RowPass:
+         ShiftRows( i0, i1 );
+         break;
+      case ColumnPass:
+         ShiftColumns( i0, i1 );
+         break;
+      case OutputPass:
+         WriteRows( i0, i1 );
+         break;
+      }
+   }
+
+private:
+
+   enum { RowPass, ColumnPass, OutputPass };
+
+   enum { BlockColumns = 8 }; // columns gathered at once by the column pass
+
+         WarpOutput<P>     m_output;
+   const GenericImage<P>&  m_image;
+         int               m_x0, m_x1, m_y0, m_y1; // output region mapped inside the image
+         int               m_ox, m_oy;             // plane coordinates of the output origin
+         double            m_fx, m_fy;             // fractional shift
+         int               m_rows, m_cols;         // padded plane
+         Array<double>     m_bx, m_by;             // margin blending weights
+         Array<Array<T> >  m_planes;               // one plane, or one per channel if streamed
+         int               m_pass;
+         int               m_channel;              // channel of the row and column passes
+         int               m_c0, m_c1;             // channels of the output pass
+
+   Array<T>& Plane( int c )
+   {
+      return m_planes[(m_planes.Length() > 1) ? c : 0];
+   }
+
+   // Row and column passes of the channel m_channel.
+   bool ShiftPlane( int numberOfThreads )
+   {
+      m_pass = RowPass;
+      if ( !RunWarpBands( *this, m_image.Height(), numberOfThreads ) )
+         return false;
+
+      // The row shift is linear, so the bottom margin can join shifted rows.
+      Array<T>& plane = Plane( m_channel );
+      const int h = m_image.Height();
+      const T* top = plane.Begin() + size_type( FourierPadding )*m_cols;
+      const T* bottom = plane.Begin() + size_type( h-1 + FourierPadding )*m_cols;
+      for ( int k = 0; k < int( m_by.Length() ); ++k )
+      {
+         T* d = plane.Begin() + size_type( (h + FourierPadding + k)%m_rows )*m_cols;
+         for ( int u = 0; u < m_cols; ++u )
+            d[u] = T( bottom[u] + m_by[k]*(double( top[u] ) - bottom[u]) );
+      }
+
+      m_pass = ColumnPass;
+      return RunWarpBands( *this, m_x1 - m_x0, numberOfThreads );
+   }
+
+   // Pads the image rows [y0,y1) and shifts them.
+   void ShiftRows( int y0, int y1 )
+   {
+      const int w = m_image.Width();
+      FourierLineShift<T> shift( m_cols, m_fx );
+      const typename P::sample* src = m_image.PixelData( m_channel );
+      Array<T>& plane = Plane( m_channel );
+      for ( int y = y0; y < y1; ++y )
+      {
+         const typename P::sample* s = src + size_type( y )*w;
+         T* d = plane.Begin() + size_type( y + FourierPadding )*m_cols;
+         for ( int x = 0; x < w; ++x )
+            d[x + FourierPadding] = T( s[x] );
+         for ( int k = 0; k < int( m_bx.Length() ); ++k )
+            d[(w + FourierPadding + k)%m_cols] = T( s[w-1] + m_bx[k]*(double( s[0] ) - s[w-1]) );
+         shift( d );
+         if ( !RowDone( y ) )
+            return;
+      }
+   }
+
+   // Shifts the plane columns of the output columns [m_x0+i0,m_x0+i1).
+   void ShiftColumns( int i0, int i1 )
+   {
+      FourierLineShift<T> shift( m_rows, m_fy );
+      Array<T> buffer( size_type( BlockColumns )*m_rows );
+      Array<T>& plane = Plane( m_channel );
+      for ( int b0 = i0; b0 < i1; b0 += BlockColumns )
+      {
+         const int n = Min( int( BlockColumns ), i1 - b0 );
+         const T* p = plane.Begin() + m_ox + m_x0 + b0;
+         for ( int r = 0; r < m_rows; ++r, p += m_cols )
+            for ( int j = 0; j < n; ++j )
+               buffer[size_type( j )*m_rows + r] = p[j];
+         for ( int j = 0; j < n; ++j )
+            shift( buffer.Begin() + size_type( j )*m_rows );
+         // Only the rows that reach the output go back to the plane.
+         for ( int y = m_y0; y < m_y1; ++y )
+         {
+            T* q = plane.Begin() + size_type( y + m_oy )*m_cols + m_ox + m_x0 + b0;
+            for ( int j = 0; j < n; ++j )
+               q[j] = buffer[size_type( j )*m_rows + y + m_oy];
+         }
+         if ( !RowDone( m_x0 + b0 + n-1 ) )
+            return;
+      }
+   }
+
+   // Writes the channels [m_c0,m_c1) of the output rows [y0,y1).
+   void WriteRows( int y0, int y1 )
+   {
+      const int ow = m_output.Width();
+      Array<typename P::sample> buffer( m_output.BufferLength( m_image.NumberOfChannels() ) );
+      Array<typename P::sample*> out( size_type( m_image.NumberOfChannels() ) );
+      for ( int y = y0; y < y1; ++y )
+      {
+         for ( int c = m_c0; c < m_c1; ++c )
+         {
+            typename P::sample* d = out[c] = m_output.Row( buffer.Begin(), y, c );
+            if ( y < m_y0 || y >= m_y1 )
+               Fill( d, d + ow, typename P::sample( 0 ) );
+            else
+            {
+               const T* g = Plane( c ).Begin() + size_type( y + m_oy )*m_cols + m_ox;
+               Fill( d, d + m_x0, typename P::sample( 0 ) );
+               for ( int x = m_x0; x < m_x1; ++x )
+                  d[x] = WarpSample<P>( g[x] );
+               Fill( d + m_x1, d + ow, typename P::sample( 0 ) );
+            }
+         }
+         m_output.Flush( y, out.Begin() );
+         if ( !RowDone( y ) )
+            return;
+      }
+   }
+};
+
+/*
+ * Applies the Fourier-domain translation (dx,dy) to every channel of the
+ * image, see FourierShiftTask. Returns false if the monitor has requested an
+ * abort.
+ */
+template <class P>
+bool FourierShiftImage( GenericImage<P>& output, const GenericImage<P>& image, double dx, double dy,
+                        WarpMonitor* monitor, int numberOfThreads )
+{
+   FourierShiftTask<P> task( WarpOutput<P>( output ), image, dx, dy, monitor );
+   return task.Shift( numberOfThreads );
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Warp task factories instantiated for a sample type and a filter, one for
+ * each transformation class. A factory returns a new task that generates the
+ * output image, or streams its rows, from the homography M; the task belongs
+ * to the caller, who runs it with RunWarpBands().
+ */
+template <class P>
+struct WarpFunctions
+{
+   typedef WarpBandTask* (*function)( const WarpOutput<P>& output, const GenericImage<P>& image, const Matrix& M,
+                                      const WarpKernel& K, WarpMonitor* monitor );
+
+   function translation;
+   function affine;
+   function projective;
+};
+
+template <class P, class F>
+WarpBandTask* NewTranslationTask( const WarpOutput<P>& output, const GenericImage<P>& image, const Matrix& M,
+                                  const WarpKernel& K, WarpMonitor* monitor )
+{
+   return new TranslationTask<P, F>( output, image, M[0][2]/M[2][2], M[1][2]/M[2][2], K, monitor );
+}
+
+template <class P, class F, bool Projective>
+WarpBandTask* NewKernelWarpTask( const WarpOutput<P>& output, const GenericImage<P>& image, const Matrix& M,
+                                 const WarpKernel& K, WarpMonitor* monitor )
+{
+   return new KernelWarpTask<P, F, Projective>( output, image, M, K, monitor );
+}
+
+/*
+ * Image warping with the pixel interpolation selected by a CAPixelInterpolation
+ * mode.
+ *
+ * The interpolation mode is resolved once, at construction, into template
+ * instantiations of the warp loops for every combination of sample type,
+ * filter (number of taps and clamping rule) and transformation class
+ * (translation, affine, projective). Apply() only has to pick one of them.
+ */
+class WarpEngine
+{
+public:
+
+   /*
+    * Translations within shiftTolerance pixels of a whole-pixel shift, on both
+    * axes, are applied as whole-pixel shifts if the kernel is interpolating.
+    */
+   WarpEngine( pcl_enum interpolation, float clampingThreshold, double shiftTolerance = 1.0e-03 );
+
+   /*
+    * Applies the homography M, which maps output pixel coordinates to source
+    * image coordinates, to the image. Output pixels mapped outside the source
+    * image are set to zero. The output is generated by up to numberOfThreads
+    * concurrent bands of rows.
+    *
+    * Translations are split into integer and fractional parts. If the
+    * fractional part is negligible and the kernel is interpolating, or with
+    * nearest neighbor interpolation, where it is always rounded away, the
+    * image is just shifted in place by whole pixels with ShiftImage().
+    * Otherwise the integer part becomes a source pointer offset of the
+    * separable translation engine, or of the Fourier shift in
+    * CAPixelInterpolation::FourierShift mode. Other transformations are
+    * applied with a Lanczos-3 kernel in that mode.
+    *
+    * Except for whole-pixel shifts, the output is generated in a new image
+    * that is then copied to the image; see Warp() to provide the output
+    * buffer instead.
+    *
+    * Returns false if the monitor has requested an abort, in which case the
+    * image is left unchanged.
+    */
+   template <class P>
+   bool Apply( GenericImage<P>& image, const Matrix& M, WarpMonitor* monitor = 0, int numberOfThreads = 1 ) const
+   {
+      int ix, iy;
+      if ( IsWholePixelShift( ix, iy, M, image.Width(), image.Height() ) )
+      {
+         ShiftImage( image, ix, iy );
+         return true;
+      }
+
+      GenericImage<P> output;
+      output.AllocateData( image.Width(), image.Height(), image.NumberOfChannels(), image.ColorSpace() );
+      bool done = Warp( output, image, M, monitor, numberOfThreads );
+      if ( done )
+         image.Assign( output );
+      return done;
+   }
+
+   /*
+    * Generates in output the image transformed by the homography M, as
+    * Apply() does. The output image must have the number of channels of the
+    * source image, and is not allocated: this allows the caller to reuse a
+    * buffer across frames. Its width and height are free: output pixel
+    * coordinates are mapped to the source by M, so a smaller output image
+    * receives a crop of the warped image. Every output pixel is written,
+    * zeros included, and whole-pixel shifts are copied row by row.
+    *
+    * Returns false if the monitor has requested an abort, in which case the
+    * contents of output are undefined.
+    */
+   template <class P>
+   bool Warp( GenericImage<P>& output, const GenericImage<P>& image, const Matrix& M,
+              WarpMonitor* monitor = 0, int numberOfThreads = 1 ) const
+   {
+      if ( IsFourierShift( M, image ) )
+         return FourierShiftImage( output, image, M[0][2]/M[2][2], M[1][2]/M[2][2], monitor, numberOfThreads );
+
+      return RunWarpTask( NewTask( WarpOutput<P>( output ), image, M, monitor ), output.Height(), numberOfThreads );
+   }
+
+   /*
+    * Generates in each outputs[i] the image transformed by the homography
+    * M[i], as Warp() does, in a single sweep over the source image: the
+    * outputs are generated in interleaved blocks of rows by a MultiWarpTask,
+    * so the source pixels and kernel neighbourhoods loaded for one output are
+    * reused from cache by the others. Fourier shifts transform whole planes
+    * and are generated separately.
+    *
+    * Returns false if the monitor has requested an abort, in which case the
+    * contents of the outputs are undefined.
+    */
+   template <class P>
+   bool Warp( const Array<GenericImage<P>*>& outputs, const GenericImage<P>& image, const Array<Matrix>& M,
+              WarpMonitor* monitor = 0, int numberOfThreads = 1 ) const
+   {
+      Array<WarpBandTask*> tasks;
+      Array<int> rows;
+      int height = 0;
+      bool done = true;
+      try
+      {
+         for ( size_type i = 0; i < outputs.Length(); ++i )
+            if ( IsFourierShift( M[i], image ) )
+            {
+               if ( !FourierShiftImage( *outputs[i], image, M[i][0][2]/M[i][2][2], M[i][1][2]/M[i][2][2],
+                                        monitor, numberOfThreads ) )
+               {
+                  done = false;
+                  break;
+               }
+            }
+            else
+            {
+               tasks.Add( NewTask( WarpOutput<P>( *outputs[i] ), image, M[i], 0 ) );
+               rows.Add( outputs[i]->Height() );
+               height = Max( height, outputs[i]->Height() );
+            }
+
+         if ( done && !tasks.IsEmpty() )
+         {
+            MultiWarpTask task( tasks, rows, monitor );
+            done = RunWarpBands( task, height, numberOfThreads );
+         }
+      }
+      catch ( ... )
+      {
+         for ( size_type i = 0; i < tasks.Length(); ++i )
+            delete tasks[i];
+         throw;
+      }
+      for ( size_type i = 0; i < tasks.Length(); ++i )
+         delete tasks[i];
+      return done;
+   }
+
+   /*
+    * Applies the homography M to the image as Apply() does, but instead of
+    * generating an output image, passes each output row to the sink as soon
+    * as it has been interpolated. This allows the warped image to be consumed
+    * in the same pass that generates it, without an intermediate buffer. The
+    * streamed image has width x height pixels, as the output of Warp().
+    *
+    * The Fourier shift transforms whole columns, so in that mode a padded
+    * plane of each channel, not an output image, is kept until its rows have
+    * been streamed; see FourierShiftTask. An Error is thrown if the planes
+    * cannot be allocated.
+    *
+    * Returns false if the monitor has requested an abort.
+    */
+   template <class P>
+   bool Stream( const GenericImage<P>& image, const Matrix& M, WarpRowSink<P>& sink, int width, int height,
+                WarpMonitor* monitor = 0, int numberOfThreads = 1 ) const
+   {
+      return StreamBands( image, M, sink, width, height, monitor, numberOfThreads, 1 );
+   }
+
+   /*
+    * Streams the image transformed by M as Stream() does, binned: each pixel
+    * of the streamed width x height image is the mean of binning x binning
+    * interpolated subsamples. M maps the coordinates of the subsamples, those
+    * of an unbinned width*binning x height*binning output, to the source
+    * image. The subsamples are generated row by row and reduced as they are
+    * streamed, so no unbinned image is ever allocated.
+    */
+   template <class P>
+   bool StreamBinned( const GenericImage<P>& image, const Matrix& M, WarpRowSink<P>& sink, int width, int height,
+                      int binning, WarpMonitor* monitor = 0, int numberOfThreads = 1 ) const
+   {
+      if ( binning <= 1 )
+         return Stream( image, M, sink, width, height, monitor, numberOfThreads );
+      // Bands of whole binned rows: each binned row is reduced by one thread.
+      WarpBinning<P> bins( sink, width, height, image.NumberOfChannels(), binning );
+      return StreamBands( image, M, bins, width*binning, height*binning, monitor, numberOfThreads, binning );
+   }
+
+   /*
+    * Generates in output the binned image transformed by M, as streamed by
+    * StreamBinned(). The output image has the number of channels of the
+    * source image and the binned geometry.
+    */
+   template <class P>
+   bool WarpBinned( GenericImage<P>& output, const GenericImage<P>& image, const Matrix& M, int binning,
+                    WarpMonitor* monitor = 0, int numberOfThreads = 1 ) const
+   {
+      if ( binning <= 1 )
+         return Warp( output, image, M, monitor, numberOfThreads );
+      WarpImageSink<P> rows( output );
+      return StreamBinned( image, M, rows, output.Width(), output.Height(), binning, monitor, numberOfThreads );
+   }
+
+   const WarpKernel& Kernel() const
+   {
+      return m_kernel;
+   }
+
+   /*
+    * True if Apply() transforms images by M in place, as a whole-pixel shift
+    * that needs no output buffer.
+    */
+   bool IsWholePixelShift( const Matrix& M ) const
+   {
+      int ix, iy;
+      return IsWholePixelShift( ix, iy, M, int_max, int_max );
+   }
+
+private:
+
+   WarpKernel m_kernel;         // exact weights
+   WarpKernel m_lutKernel;      // Lanczos and cubic weights from lookup tables
+   double     m_shiftTolerance; // largest fractional shift treated as zero
+   bool       m_fourier;        // translations in the Fourier domain
+
+   /*
+    * True if M is a translation (dx,dy) that can be applied as the whole-pixel
+    * shift (ix,iy) of a width x height image: always with nearest neighbor
+    * interpolation, which rounds half pixels up as WarpKernel does, and for
+    * negligible fractional shifts with interpolating kernels.
+    */
+   bool IsWholePixelShift( int& ix, int& iy, const Matrix& M, int width, int height ) const
+   {
+      if ( !IsTranslationMatrix( M ) )
+         return false;
+      double dx = M[0][2]/M[2][2];
+      double dy = M[1][2]/M[2][2];
+      double fx = Floor( dx + 0.5 );
+      double fy = Floor( dy + 0.5 );
+      if ( m_kernel.Interpolation() == CAPixelInterpolation::NearestNeighbor
+        || (m_kernel.IsInterpolating() && Abs( dx - fx ) <= m_shiftTolerance && Abs( dy - fy ) <= m_shiftTolerance) )
+      {
+         ix = TruncInt( Range( fx, -double( width ), double( width ) ) );
+         iy = TruncInt( Range( fy, -double( height ), double( height ) ) );
+         return true;
+      }
+      return false;
+   }
+
+   /*
+    * True if M is a translation applied in the Fourier domain by this engine.
+    */
+   template <class P>
+   bool IsFourierShift( const Matrix& M, const GenericImage<P>& image ) const
+   {
+      int ix, iy;
+      return m_fourier && IsTranslationMatrix( M ) && !IsWholePixelShift( ix, iy, M, image.Width(), image.Height() );
+   }
+
+   /*
+    * New task generating the output from the homography M: a whole-pixel
+    * shift, a separable translation, or a kernel warp. Fourier shifts are not
+    * band tasks; see IsFourierShift().
+    */
+   template <class P>
+   WarpBandTask* NewTask( const WarpOutput<P>& output, const GenericImage<P>& image, const Matrix& M,
+                          WarpMonitor* monitor ) const
+   {
+      int ix, iy;
+      if ( IsWholePixelShift( ix, iy, M, image.Width(), image.Height() ) )
+         return new ShiftTask<P>( output, image, ix, iy, monitor );
+
+      const WarpFunctions<P>& f = Functions( (P*)0 );
+      typename WarpFunctions<P>::function task = IsTranslationMatrix( M ) ? f.translation :
+                                                     (IsAffineMatrix( M ) ? f.affine : f.projective);
+      return (*task)( output, image, M, WarpTraits<P>::LUT ? m_lutKernel : m_kernel, monitor );
+   }
+
+   /*
+    * Stream() with bands of rows starting at multiples of align rows. Each
+    * band passes its rows to the sink in order, from a single thread.
+    */
+   template <class P>
+   bool StreamBands( const GenericImage<P>& image, const Matrix& M, WarpRowSink<P>& sink, int width, int height,
+                     WarpMonitor* monitor, int numberOfThreads, int align ) const
+   {
+      if ( IsFourierShift( M, image ) )
+      {
+         FourierShiftTask<P> task( WarpOutput<P>( sink, width, height ), image, M[0][2]/M[2][2], M[1][2]/M[2][2], monitor );
+         return task.Shift( numberOfThreads, align );
+      }
+
+      return RunWarpTask( NewTask( WarpOutput<P>( sink, width, height ), image, M, monitor ), height, numberOfThreads, align );
+   }
+
+   /*
+    * Runs a task returned by NewTask() and destroys it.
+    */
+   static bool RunWarpTask( WarpBandTask* task, int rows, int numberOfThreads, int align = 1 )
+   {
+      bool done;
+      try
+      {
+         done = RunWarpBands( *task, rows, numberOfThreads, align );
+      }
+      catch ( ... )
+      {
+         delete task;
+         throw;
+      }
+      delete task;
+      return done;
+   }
+
+   WarpFunctions<FloatPixelTraits>  m_float;
+   WarpFunctions<DoublePixelTraits> m_double;
+   WarpFunctions<UInt8PixelTraits>  m_uint8;
+   WarpFunctions<UInt16PixelTraits> m_uint16;
+   WarpFunctions<UInt32PixelTraits> m_uint32;
+
+   const WarpFunctions<FloatPixelTraits>& Functions( FloatPixelTraits* ) const
+   {
+      return m_float;
+   }
+
+   const WarpFunctions<DoublePixelTraits>& Functions( DoublePixelTraits* ) const
+   {
+      return m_double;
+   }
+
+   const WarpFunctions<UInt8PixelTraits>& Functions( UInt8PixelTraits* ) const
+   {
+      return m_uint8;
+   }
+
+   const WarpFunctions<UInt16PixelTraits>& Functions( UInt16PixelTraits* ) const
+   {
+      return m_uint16;
+   }
+
+   const WarpFunctions<UInt32PixelTraits>& Functions( UInt32PixelTraits* ) const
+   {
+      return m_uint32;
+   }
+
+   template <class F>
+   void Select();
+
+   template <int N>
+   void SelectLanczos( int clampMode );
+};
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+#endif   // __WarpEngine_h
+
+// ****************************************************************************
+// EOF WarpEngine.h - Released 2015/03/04 19:50:08 UTC
@@ -0,0 +1,360 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// WarpSIMD.cpp - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#include "WarpSIMD.h"
+#include "WarpEngine.h"
+
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __i386__ ) || defined( _M_IX86 )
+#  define CA_X86_SIMD 1
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#     include <intrin.h>
+#     define CA_TARGET_AVX2
+#     define CA_TARGET_AVX512
+#  else
+#     include <cpuid.h>
+#     define CA_TARGET_AVX2   __attribute__((target("avx2,fma")))
+#     define CA_TARGET_AVX512 __attribute__((target("avx512f")))
+#  endif
+#endif
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+#ifdef CA_X86_SIMD
+
+CA_TARGET_AVX2
+static inline __m256 Gather8( const float* src, __m256i o )
+{
+   return _mm256_i32gather_ps( src, o, 4 );
+}
+
+CA_TARGET_AVX2
+static inline __m256 Gather8( const uint16* src, __m256i o )
+{
+   __m256i v = _mm256_i32gather_epi32( reinterpret_cast<const int*>( src ), o, 2 );
+   return _mm256_cvtepi32_ps( _mm256_and_si256( v, _mm256_set1_epi32( 0xffff ) ) );
+}
+
+CA_TARGET_AVX2
+static inline __m256 Combine8( const __m256* f, const __m256* w, int taps, int clampMode, __m256 clamp )
+{
+   switch ( clampMode )
+   {
+   case WarpKernel::SplineClamp:
+      {
+         __m256 f12 = _mm256_fmadd_ps( f[1], w[1], _mm256_mul_ps( f[2], w[2] ) );
+         __m256 f03 = _mm256_fmadd_ps( f[0], w[0], _mm256_mul_ps( f[3], w[3] ) );
+         __m256 cubic = _mm256_add_ps( f12, f03 );
+         __m256 linear = _mm256_div_ps( f12, _mm256_add_ps( w[1], w[2] ) );
+         // -f03 < f12*clamp ? cubic : linear
+         __m256 useCubic = _mm256_cmp_ps( _mm256_sub_ps( _mm256_setzero_ps(), f03 ), _mm256_mul_ps( f12, clamp ), _CMP_LT_OQ );
+         return _mm256_blendv_ps( linear, cubic, useCubic );
+      }
+   case WarpKernel::LanczosClamp:
+      {
+         __m256 sp = _mm256_setzero_ps(), sn = sp, wp = sp;
+         for ( int j = 0; j < taps; ++j )
+         {
+            __m256 neg = _mm256_cmp_ps( w[j], _mm256_setzero_ps(), _CMP_LT_OQ );
+            __m256 s = _mm256_mul_ps( f[j], w[j] );
+            sn = _mm256_sub_ps( sn, _mm256_and_ps( neg, s ) );
+            sp = _mm256_add_ps( sp, _mm256_andnot_ps( neg, s ) );
+            wp = _mm256_add_ps( wp, _mm256_andnot_ps( neg, w[j] ) );
+         }
+         __m256 full = _mm256_sub_ps( sp, sn );
+         __m256 positive = _mm256_div_ps( sp, wp );
+         // sn < clamp*sp ? full : positive
+         __m256 useFull = _mm256_cmp_ps( sn, _mm256_mul_ps( clamp, sp ), _CMP_LT_OQ );
+         return _mm256_blendv_ps( positive, full, useFull );
+      }
+   default:
+      {
+         __m256 s = _mm256_mul_ps( f[0], w[0] );
+         for ( int j = 1; j < taps; ++j )
+            s = _mm256_fmadd_ps( f[j], w[j], s );
+         return s;
+      }
+   }
+}
+
+template <typename T>
+CA_TARGET_AVX2
+static void RowAVX2( float* const* out, const T* const* src, int nc, int n, const WarpRowData& row )
+{
+   const int taps = row.taps;
+   const __m256 clamp = _mm256_set1_ps( row.clamp );
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8 )
+   {
+      __m256i o = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( row.off + i ) );
+      __m256 wx[ WarpKernel::MaxTaps ], wy[ WarpKernel::MaxTaps ];
+      for ( int j = 0; j < taps; ++j )
+      {
+         wx[j] = _mm256_loadu_ps( row.wx + j*row.stride + i );
+         wy[j] = _mm256_loadu_ps( row.wy + j*row.stride + i );
+      }
+
+      for ( int c = 0; c < nc; ++c )
+      {
+         __m256 r[ WarpKernel::MaxTaps ];
+         for ( int k = 0; k < taps; ++k )
+         {
+            __m256i ok = _mm256_add_epi32( o, _mm256_set1_epi32( k*row.width ) );
+            __m256 f[ WarpKernel::MaxTaps ];
+            for ( int j = 0; j < taps; ++j )
+               f[j] = Gather8( src[c], _mm256_add_epi32( ok, _mm256_set1_epi32( j ) ) );
+            r[k] = Combine8( f, wx, taps, row.clampMode, clamp );
+         }
+         _mm256_storeu_ps( out[c] + i, Combine8( r, wy, taps, row.clampMode, clamp ) );
+      }
+   }
+   if ( i < n )
+      WarpRowScalar( out, src, nc, i, n, row );
+}
+
+// ----------------------------------------------------------------------------
+
+CA_TARGET_AVX512
+static inline __m512 Gather16( const float* src, __m512i o )
+{
+   return _mm512_i32gather_ps( o, src, 4 );
+}
+
+CA_TARGET_AVX512
+static inline __m512 Gather16( const uint16* src, __m512i o )
+{
+   __m512i v = _mm512_i32gather_epi32( o, src, 2 );
+   return _mm512_cvtepi32_ps( _mm512_and_si512( v, _mm512_set1_epi32( 0xffff ) ) );
+}
+
+CA_TARGET_AVX512
+static inline __m512 Combine16( const __m512* f, const __m512* w, int taps, int clampMode, __m512 clamp )
+{
+   switch ( clampMode )
+   {
+   case WarpKernel::SplineClamp:
+      {
+         __m512 f12 = _mm512_fmadd_ps( f[1], w[1], _mm512_mul_ps( f[2], w[2] ) );
+         __m512 f03 = _mm512_fmadd_ps( f[0], w[0], _mm512_mul_ps( f[3], w[3] ) );
+         __m512 cubic = _mm512_add_ps( f12, f03 );
+         __m512 linear = _mm512_div_ps( f12, _mm512_add_ps( w[1], w[2] ) );
+         __mmask16 useCubic = _mm512_cmp_ps_mask( _mm512_sub_ps( _mm512_setzero_ps(), f03 ), _mm512_mul_ps( f12, clamp ), _CMP_LT_OQ );
+         return _mm512_mask_blend_ps( useCubic, linear, cubic );
+      }
+   case WarpKernel::LanczosClamp:
+      {
+         __m512 sp = _mm512_setzero_ps(), sn = sp, wp = sp;
+         for ( int j = 0; j < taps; ++j )
+         {
+            __mmask16 neg = _mm512_cmp_ps_mask( w[j], _mm512_setzero_ps(), _CMP_LT_OQ );
+            __m512 s = _mm512_mul_ps( f[j], w[j] );
+            sn = _mm512_mask_sub_ps( sn, neg, sn, s );
+            sp = _mm512_mask_add_ps( sp, _mm512_knot( neg ), sp, s );
+            wp = _mm512_mask_add_ps( wp, _mm512_knot( neg ), wp, w[j] );
+         }
+         __m512 full = _mm512_sub_ps( sp, sn );
+         __m512 positive = _mm512_div_ps( sp, wp );
+         __mmask16 useFull = _mm512_cmp_ps_mask( sn, _mm512_mul_ps( clamp, sp ), _CMP_LT_OQ );
+         return _mm512_mask_blend_ps( useFull, positive, full );
+      }
+   default:
+      {
+         __m512 s = _mm512_mul_ps( f[0], w[0] );
+         for ( int j = 1; j < taps; ++j )
+            s = _mm512_fmadd_ps( f[j], w[j], s );
+         return s;
+      }
+   }
+}
+
+template <typename T>
+CA_TARGET_AVX512
+static void RowAVX512( float* const* out, const T* const* src, int nc, int n, const WarpRowData& row )
+{
+   const int taps = row.taps;
+   const __m512 clamp = _mm512_set1_ps( row.clamp );
+   int i = 0;
+   for ( ; i + 16 <= n; i += 16 )
+   {
+      __m512i o = _mm512_loadu_si512( row.off + i );
+      __m512 wx[ WarpKernel::MaxTaps ], wy[ WarpKernel::MaxTaps ];
+      for ( int j = 0; j < taps; ++j )
+      {
+         wx[j] = _mm512_loadu_ps( row.wx + j*row.stride + i );
+         wy[j] = _mm512_loadu_ps( row.wy + j*row.stride + i );
+      }
+
+      for ( int c = 0; c < nc; ++c )
+      {
+         __m512 r[ WarpKernel::MaxTaps ];
+         for ( int k = 0; k < taps; ++k )
+         {
+            __m512i ok = _mm512_add_epi32( o, _mm512_set1_epi32( k*row.width ) );
+            __m512 f[ WarpKernel::MaxTaps ];
+            for ( int j = 0; j < taps; ++j )
+               f[j] = Gather16( src[c], _mm512_add_epi32( ok, _mm512_set1_epi32( j ) ) );
+            r[k] = Combine16( f, wx, taps, row.clampMode, clamp );
+         }
+         _mm512_storeu_ps( out[c] + i, Combine16( r, wy, taps, row.clampMode, clamp ) );
+      }
+   }
+   if ( i < n )
+      WarpRowScalar( out, src, nc, i, n, row );
+}
+
+// ----------------------------------------------------------------------------
+
+static void CPUID( int* r, int leaf, int subleaf )
+{
+#ifdef _MSC_VER
+   __cpuidex( r, leaf, subleaf );
+#else
+   unsigned a, b, c, d;
+   __cpuid_count( leaf, subleaf, a, b, c, d );
+   r[0] = int( a ); r[1] = int( b ); r[2] = int( c ); r[3] = int( d );
+#endif
+}
+
+static uint64 XGETBV()
+{
+#ifdef _MSC_VER
+   return _xgetbv( 0 );
+#else
+   unsigned a, d;
+   __asm__ __volatile__ ( "xgetbv" : "=a" (a), "=d" (d) : "c" (0) );
+   return (uint64( d ) << 32) | a;
+#endif
+}
+
+static int DetectSIMDLevel()
+{
+   int r[ 4 ];
+   CPUID( r, 0, 0 );
+   if ( r[0] < 7 )
+      return 0;
+
+   CPUID( r, 1, 0 );
+   const bool osxsave = (r[2] & (1 << 27)) != 0;
+   const bool fma = (r[2] & (1 << 12)) != 0;
+   if ( !osxsave || !fma )
+      return 0;
+
+   // The OS must preserve the YMM (and ZMM) register state.
+   const uint64 xcr0 = XGETBV();
+   if ( (xcr0 & 0x06) != 0x06 )
+      return 0;
+
+   CPUID( r, 7, 0 );
+   const bool avx2 = (r[1] & (1 << 5)) != 0;
+   const bool avx512f = (r[1] & (1 << 16)) != 0;
+   if ( avx512f && (xcr0 & 0xe0) == 0xe0 )
+      return 2;
+   return avx2 ? 1 : 0;
+}
+
+#endif   // CA_X86_SIMD
+
+// ----------------------------------------------------------------------------
+
+static int s_maxSIMDLevel = 2; // see SetWarpSIMDLevel()
+
+int WarpSIMDLevel()
+{
+#ifdef CA_X86_SIMD
+   static const int level = DetectSIMDLevel();
+   return Min( level, s_maxSIMDLevel );
+#else
+   return 0;
+#endif
+}
+
+int SetWarpSIMDLevel( int level )
+{
+   s_maxSIMDLevel = Range( level, 0, 2 );
+   return WarpSIMDLevel();
+}
+
+template <typename T>
+static void Row( float* const* out, const T* const* src, int nc, int n, const WarpRowData& row )
+{
+   switch ( WarpSIMDLevel() )
+   {
+#ifdef CA_X86_SIMD
+   case 2:
+      RowAVX512( out, src, nc, n, row );
+      break;
+   case 1:
+      RowAVX2( out, src, nc, n, row );
+      break;
+#endif
+   default:
+      WarpRowScalar( out, src, nc, 0, n, row );
+      break;
+   }
+}
+
+void WarpSIMDRow( float* const* out, const float* const* src, int numberOfChannels, int n, const WarpRowData& row )
+{
+   Row( out, src, numberOfChannels, n, row );
+}
+
+void WarpSIMDRow( float* const* out, const uint16* const* src, int numberOfChannels, int n, const WarpRowData& row )
+{
+   Row( out, src, numberOfChannels, n, row );
+}
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+// ****************************************************************************
+// EOF WarpSIMD.cpp - Released 2015/03/04 19:50:08 UTC
@@ -0,0 +1,117 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// WarpSIMD.h - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+#ifndef __WarpSIMD_h
+#define __WarpSIMD_h
+
+#include <pcl/Defs.h>
+
+namespace pcl
+{
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Interpolation geometry of a row of output pixels, shared by all channels.
+ *
+ * Pixel i takes its taps x taps source footprint from the sample offset
+ * off[i]; the horizontal and vertical weights of its tap j are
+ * wx[j*stride + i] and wy[j*stride + i]. clampMode and clamp are
+ * WarpKernel::ClampMode() and WarpKernel::ClampingThreshold().
+ */
+struct WarpRowData
+{
+   const int32* off;
+   const float* wx;
+   const float* wy;
+   int          stride;
+   int          taps;
+   int          width;     // length of a source row in samples
+   int          clampMode;
+   float        clamp;
+};
+
+/*
+ * Vectorized interpolation of the first n pixels of a row for all channels:
+ * out[c][i] receives pixel i interpolated from the source plane src[c]. The
+ * offsets and weights of each group of pixels are loaded once and applied to
+ * every channel plane.
+ *
+ * The caller guarantees that every footprint lies inside the image, and for
+ * 16-bit images that it does not include the last sample of the plane (the
+ * gathers read 32-bit words).
+ *
+ * The widest instruction set available at run time is used: AVX-512F (16
+ * pixels per iteration), AVX2+FMA (8 pixels per iteration), or portable code.
+ */
+void WarpSIMDRow( float* const* out, const float* const* src, int numberOfChannels, int n, const WarpRowData& row );
+
+void WarpSIMDRow( float* const* out, const uint16* const* src, int numberOfChannels, int n, const WarpRowData& row );
+
+/*
+ * Instruction set selected at run time: 0 = portable, 1 = AVX2, 2 = AVX-512F.
+ */
+int WarpSIMDLevel();
+
+/*
+ * Limits the instruction set used by WarpSIMDRow() to level, at most the one
+ * detected at run time, and returns the resulting WarpSIMDLevel(). Allows the
+ * vector kernels to be checked against the portable code; it must not be
+ * called while a warp is running.
+ */
+int SetWarpSIMDLevel( int level );
+
+// ----------------------------------------------------------------------------
+
+} // pcl
+
+#endif   // __WarpSIMD_h
+
+// ****************************************************************************
+// EOF WarpSIMD.h - Released 2015/03/04 19:50:08 UTC
@@ -0,0 +1,594 @@
+// ****************************************************************************
+// PixInsight Class Library - PCL 02.00.14.0695
+// Standard CometAlignment Process Module Version 01.02.06.0070
+// ****************************************************************************
+// WarpEngineCheck.cpp - Released 2015/03/04 19:50:08 UTC
+// ****************************************************************************
+// This file is part of the standard CometAlignment PixInsight module.
+//
+// Copyright (c) 2012-2015 Nikolay Volkov
+// Copyright (c) 2003-2015 Pleiades Astrophoto S.L.
+//
+// Redistribution and use in both source and binary forms, with or without
+// modification, is permitted provided that the following conditions are met:
+//
+// 1. All redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. All redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the names "PixInsight" and "Pleiades Astrophoto", nor the names
+//    of their contributors, may be used to endorse or promote products derived
+//    from this software without specific prior written permission. For written
+//    permission, please contact info@pixinsight.com.
+//
+// 4. All products derived from this software, in any form whatsoever, must
+//    reproduce the following acknowledgment in the end-user documentation
+//    and/or other materials provided with the product:
+//
+//    "This product is based on software from the PixInsight project, developed
+//    by Pleiades Astrophoto and its contributors (http://pixinsight.com/)."
+//
+//    Alternatively, if that is where third-party acknowledgments normally
+//    appear, this acknowledgment must be reproduced in the product itself.
+//
+// THIS SOFTWARE IS PROVIDED BY PLEIADES ASTROPHOTO AND ITS CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL PLEIADES ASTROPHOTO OR ITS
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, BUSINESS
+// INTERRUPTION; PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; AND LOSS OF USE,
+// DATA OR PROFITS) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// ****************************************************************************
+
+
+/*
+ * Standalone check of WarpEngine against the PCL pixel interpolations, as
+ * they were applied pixel by pixel by CAThread::HomographyApplyTo() before
+ * the warp engine existed.
+ *
+ * Every sample type (8, 16 and 32-bit integer, 32 and 64-bit float) is
+ * warped with every interpolation, by whole-pixel, sub-pixel, affine and
+ * projective transformations, through Apply(), Stream(), a streamed region
+ * of interest and WarpBinned(), on one and several threads. The vectorized
+ * sample types are checked at every instruction set available, from the
+ * widest down to the portable code; see SetWarpSIMDLevel(). Translations in
+ * CAPixelInterpolation::FourierShift mode have no PCL counterpart, so they
+ * are checked against the analytic band-limited signal sampled in the image.
+ *
+ * Build it against PCL with WarpEngine.cpp, WarpSIMD.cpp and FourierShift.cpp;
+ * it returns nonzero if any output pixel differs from the reference by more
+ * than the tolerance.
+ */
+
+#include "../WarpEngine.h"
+#include "../WarpSIMD.h"
+
+#include <pcl/Exception.h>
+#include <pcl/PixelInterpolation.h>
+#include <pcl/Random.h>
+
+#include <stdio.h>
+
+using namespace pcl;
+
+// ----------------------------------------------------------------------------
+
+/*
+ * The PCL interpolation of each CAPixelInterpolation mode, with the clamping
+ * rules of CometAlignmentInstance::InitPixelInterpolation(). Transformations
+ * other than translations use Lanczos-3 in Fourier shift mode.
+ */
+static PixelInterpolation* NewPixelInterpolation( pcl_enum interpolation, float clampingThreshold )
+{
+   // Disable Lanczos clamping when clampingThreshold == 1
+   const float clamp = (clampingThreshold < 1) ? clampingThreshold : -1;
+   switch ( interpolation )
+   {
+   case CAPixelInterpolation::NearestNeighbor:
+      return new NearestNeighborPixelInterpolation;
+   case CAPixelInterpolation::Bilinear:
+      return new BilinearPixelInterpolation;
+   default:
+   case CAPixelInterpolation::BicubicSpline:
+      return new BicubicSplinePixelInterpolation( clampingThreshold );
+   case CAPixelInterpolation::BicubicBSpline:
+      return new BicubicBSplinePixelInterpolation;
+   case CAPixelInterpolation::Lanczos3:
+   case CAPixelInterpolation::FourierShift:
+      return new LanczosPixelInterpolation( 3, clamp );
+   case CAPixelInterpolation::Lanczos4:
+      return new LanczosPixelInterpolation( 4, clamp );
+   case CAPixelInterpolation::Lanczos5:
+      return new LanczosPixelInterpolation( 5, clamp );
+   case CAPixelInterpolation::MitchellNetravaliFilter:
+      return new BicubicFilterPixelInterpolation( 2, 2, MitchellNetravaliCubicFilter() );
+   case CAPixelInterpolation::CatmullRomSplineFilter:
+      return new BicubicFilterPixelInterpolation( 2, 2, CatmullRomSplineFilter() );
+   case CAPixelInterpolation::CubicBSplineFilter:
+      return new BicubicFilterPixelInterpolation( 2, 2, CubicBSplineFilter() );
+   }
+}
+
+/*
+ * Band-limited test signal in [0.2,0.8], sampled by the smooth test images.
+ */
+static double Signal( double x, double y, int c )
+{
+   const double twoPi = 2*Const<double>::pi();
+   return 0.5 + 0.2*Sin( twoPi*x/29 + c )*Cos( twoPi*y/37 ) + 0.1*Sin( twoPi*(x + y)/43 );
+}
+
+/*
+ * Normalized value of a sample, in [0,1] for integer images.
+ */
+template <class P> inline
+double Value( const GenericImage<P>& image, int x, int y, int c )
+{
+   return double( image( x, y, c ) )/double( P::MaxSampleValue() );
+}
+
+/*
+ * The smooth image samples Signal(); the textured one adds uniform noise,
+ * clipped to [0,1], so the clamping rules are exercised and integer images
+ * include saturated samples (all bits of 16-bit words set).
+ */
+template <class P>
+static void Generate( GenericImage<P>& image, int width, int height, bool textured )
+{
+   image.AllocateData( width, height, 3, ColorSpace::RGB );
+   RandomNumberGenerator R( 1.0, 17 );
+   for ( int c = 0; c < 3; ++c )
+      for ( int y = 0; y < height; ++y )
+         for ( int x = 0; x < width; ++x )
+         {
+            double v = Signal( x, y, c );
+            if ( textured )
+               v = Range( v + 1.2*(R() - 0.5), 0.0, 1.0 );
+            image( x, y, c ) = P::ToSample( v );
+         }
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Reference values from the PCL interpolators of the source image, zero
+ * outside it. Source coordinates within 1.0e-06 pixels of the image borders,
+ * where the inside test is decided by rounding, are skipped. With nearest
+ * neighbor interpolation, translations are applied as whole-pixel shifts,
+ * which round coordinates within half a pixel of the borders to the outer
+ * side; those are skipped too.
+ */
+template <class P>
+class InterpolationReference
+{
+public:
+
+   InterpolationReference( const GenericImage<P>& image, pcl_enum interpolation, float clampingThreshold ) :
+   m_interpolation( NewPixelInterpolation( interpolation, clampingThreshold ) ),
+   m_interpolators( size_type( image.NumberOfChannels() ) ),
+   m_width( image.Width() ), m_height( image.Height() ),
+   m_nearest( interpolation == CAPixelInterpolation::NearestNeighbor )
+   {
+      for ( int c = 0; c < image.NumberOfChannels(); ++c )
+         m_interpolators[c] = m_interpolation->NewInterpolator( (P*)0, image.PixelData( c ), m_width, m_height );
+   }
+
+   ~InterpolationReference()
+   {
+      for ( size_type c = 0; c < m_interpolators.Length(); ++c )
+         delete m_interpolators[c];
+      delete m_interpolation;
+   }
+
+   bool Skip( double X, double Y ) const
+   {
+      const double edge = 1.0e-06;
+      if ( Abs( X ) < edge || Abs( X - m_width ) < edge || Abs( Y ) < edge || Abs( Y - m_height ) < edge )
+         return true;
+      return m_nearest && (NearBorder( X, m_width ) || NearBorder( Y, m_height ));
+   }
+
+   double operator()( int c, double X, double Y ) const
+   {
+      if ( X < 0 || X >= m_width || Y < 0 || Y >= m_height )
+         return 0;
+      double v = (*m_interpolators[c])( DPoint( X, Y ) )/double( P::MaxSampleValue() );
+      return P::IsFloatSample() ? v : Range( v, 0.0, 1.0 );
+   }
+
+private:
+
+   PixelInterpolation*                          m_interpolation;
+   Array<PixelInterpolation::Interpolator<P>*>  m_interpolators;
+   int                                          m_width, m_height;
+   bool                                         m_nearest;
+
+   static bool NearBorder( double z, int n )
+   {
+      return (z >= -0.5 && z <= 0) || (z >= n - 0.5 && z <= n);
+   }
+};
+
+/*
+ * Reference values of a Fourier shift of a smooth image: Signal() inside the
+ * image, zero outside. Whole columns and rows are shifted through padded
+ * planes whose margins join the opposite borders, so coordinates within
+ * Margin pixels of the borders, where the joins perturb the band-limited
+ * interpolation, are skipped.
+ */
+class SignalReference
+{
+public:
+
+   enum { Margin = 8 };
+
+   SignalReference( int width, int height ) : m_width( width ), m_height( height )
+   {
+   }
+
+   bool Skip( double X, double Y ) const
+   {
+      return NearBorder( X, m_width ) || NearBorder( Y, m_height );
+   }
+
+   double operator()( int c, double X, double Y ) const
+   {
+      if ( X < 0 || X >= m_width || Y < 0 || Y >= m_height )
+         return 0;
+      return Signal( X, Y, c );
+   }
+
+private:
+
+   int m_width, m_height;
+
+   static bool NearBorder( double z, int n )
+   {
+      return (z > -1 && z < Margin) || (z > n-1 - Margin && z < n);
+   }
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Largest difference between the output and the reference, in normalized
+ * sample units. Output pixel (x,y) is the mean of the binning x binning
+ * subsamples (x*binning+i,y*binning+j) mapped to the source image by M.
+ * Pixels with any subsample skipped by the reference are not counted.
+ */
+template <class P, class R>
+static double MaxError( int& checked, const GenericImage<P>& output, const Matrix& M, int binning, const R& reference )
+{
+   double maxError = 0;
+   checked = 0;
+   Array<double> v( size_type( output.NumberOfChannels() ) );
+   for ( int y = 0; y < output.Height(); ++y )
+      for ( int x = 0; x < output.Width(); ++x )
+      {
+         bool skip = false;
+         for ( int c = 0; c < output.NumberOfChannels(); ++c )
+            v[c] = 0;
+         for ( int j = 0; j < binning && !skip; ++j )
+            for ( int i = 0; i < binning && !skip; ++i )
+            {
+               double u = x*binning + i, w = y*binning + j;
+               double q = M[2][0]*u + M[2][1]*w + M[2][2];
+               double X = (M[0][0]*u + M[0][1]*w + M[0][2])/q;
+               double Y = (M[1][0]*u + M[1][1]*w + M[1][2])/q;
+               if ( reference.Skip( X, Y ) )
+                  skip = true;
+               else
+                  for ( int c = 0; c < output.NumberOfChannels(); ++c )
+                     v[c] += reference( c, X, Y );
+            }
+         if ( skip )
+            continue;
+         for ( int c = 0; c < output.NumberOfChannels(); ++c )
+            maxError = Max( maxError, Abs( Value( output, x, y, c ) - v[c]/binning/binning ) );
+         ++checked;
+      }
+   return maxError;
+}
+
+/*
+ * Matrix of the translation (dx,dy).
+ */
+static Matrix TranslationMatrix( double dx, double dy )
+{
+   return Matrix( 1.0, 0.0, dx,
+                  0.0, 1.0, dy,
+                  0.0, 0.0, 1.0 );
+}
+
+/*
+ * Ways of generating a warped image with the engine.
+ */
+enum { ApplyPath, StreamPath, ROIPath, BinnedPath, NumberOfPaths };
+
+static const char* PathName( int path )
+{
+   static const char* names[] = { "Apply", "Stream", "Stream ROI", "WarpBinned" };
+   return names[path];
+}
+
+/*
+ * Warps the image by M with the engine through the given path, returning in
+ * output the warped image, in Mout the matrix that maps its pixels (its
+ * subsamples, for binned paths) to the source image, and in binning their
+ * binning factor. Returns false if the warp fails.
+ */
+template <class P>
+static bool Warp( GenericImage<P>& output, Matrix& Mout, int& binning, const WarpEngine& engine,
+                  const GenericImage<P>& image, const Matrix& M, int path, int numberOfThreads )
+{
+   const int w = image.Width();
+   const int h = image.Height();
+   Mout = M;
+   binning = 1;
+   switch ( path )
+   {
+   default:
+   case ApplyPath:
+      output.Assign( image );
+      return engine.Apply( output, M, 0, numberOfThreads );
+   case StreamPath:
+      {
+         output.AllocateData( w, h, image.NumberOfChannels(), image.ColorSpace() );
+         WarpImageSink<P> sink( output );
+         return engine.Stream( image, M, sink, w, h, 0, numberOfThreads );
+      }
+   case ROIPath:
+      {
+         // An odd region that doesn't start at the origin.
+         const int x0 = 23, y0 = 17;
+         Mout = M*TranslationMatrix( x0, y0 );
+         output.AllocateData( w/2 + 1, h/2 - 7, image.NumberOfChannels(), image.ColorSpace() );
+         WarpImageSink<P> sink( output );
+         return engine.Stream( image, Mout, sink, output.Width(), output.Height(), 0, numberOfThreads );
+      }
+   case BinnedPath:
+      binning = 3;
+      output.AllocateData( w/binning, h/binning, image.NumberOfChannels(), image.ColorSpace() );
+      return engine.WarpBinned( output, image, M, binning, 0, numberOfThreads );
+   }
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Checks of the sample type P, with the images of w x h pixels.
+ */
+template <class P>
+class TypeCheck
+{
+public:
+
+   TypeCheck( const char* typeName, int w, int h ) : m_typeName( typeName ), m_level( 0 ), m_failed( 0 )
+   {
+      Generate( m_textured, w, h, true );
+      Generate( m_smooth, w, h, false );
+   }
+
+   int Failed() const
+   {
+      return m_failed;
+   }
+
+   void SetLevel( int level )
+   {
+      m_level = level;
+   }
+
+   /*
+    * Compares the image warped by M through path with the reference: the PCL
+    * interpolation, or the shifted Signal() for Fourier shifts.
+    */
+   void Check( const char* what, const Matrix& M, pcl_enum interpolation, int path, int numberOfThreads )
+   {
+      const float clamp = 0.3F;
+      WarpEngine engine( interpolation, clamp );
+      const bool fourier = interpolation == CAPixelInterpolation::FourierShift
+                        && IsTranslationMatrix( M ) && !engine.IsWholePixelShift( M );
+      const GenericImage<P>& source = fourier ? m_smooth : m_textured;
+
+      GenericImage<P> output;
+      Matrix Mout;
+      int binning;
+      if ( !Warp( output, Mout, binning, engine, source, M, path, numberOfThreads ) )
+      {
+         Report( what, interpolation, path, numberOfThreads, 0, 0, false );
+         return;
+      }
+
+      int checked;
+      double maxError = fourier ?
+         MaxError( checked, output, Mout, binning, SignalReference( source.Width(), source.Height() ) ) :
+         MaxError( checked, output, Mout, binning, InterpolationReference<P>( source, interpolation, clamp ) );
+
+      Report( what, interpolation, path, numberOfThreads, checked, maxError,
+              checked > 0 && maxError <= Tolerance( fourier ? 3.0e-03 : WeightTolerance() ) );
+   }
+
+   /*
+    * Checks that the translation M is applied in place as a whole-pixel
+    * shift, and compares the result with the PCL interpolation of the whole
+    * translation Mref.
+    */
+   void CheckWholePixel( const char* what, const Matrix& M, const Matrix& Mref, pcl_enum interpolation )
+   {
+      const float clamp = 0.3F;
+      WarpEngine engine( interpolation, clamp );
+      if ( !engine.IsWholePixelShift( M ) )
+      {
+         Report( what, interpolation, ApplyPath, 1, 0, 0, false );
+         return;
+      }
+
+      GenericImage<P> output;
+      output.Assign( m_textured );
+      int checked = 0;
+      double maxError = 0;
+      bool done = engine.Apply( output, M );
+      if ( done )
+         maxError = MaxError( checked, output, Mref, 1, InterpolationReference<P>( m_textured, interpolation, clamp ) );
+      Report( what, interpolation, ApplyPath, 1, checked, maxError, done && maxError <= Tolerance( 0 ) );
+   }
+
+private:
+
+   const char*     m_typeName;
+   GenericImage<P> m_textured, m_smooth;
+   int             m_level;
+   int             m_failed;
+
+   /*
+    * Weights are applied in single precision to 8-bit, 16-bit and 32-bit
+    * float images, in double precision to 32-bit integer and 64-bit float
+    * images; see WarpTraits.
+    */
+   static double WeightTolerance()
+   {
+      return (sizeof( typename WarpTraits<P>::weight ) < sizeof( double )) ? 1.0e-05 : 1.0e-09;
+   }
+
+   /*
+    * Integer outputs are rounded to the nearest sample value, and binned ones
+    * are means of rounded subsamples: allow one sample step.
+    */
+   static double Tolerance( double tolerance )
+   {
+      return P::IsFloatSample() ? tolerance : tolerance + 1.0/double( P::MaxSampleValue() );
+   }
+
+   void Report( const char* what, pcl_enum interpolation, int path, int numberOfThreads,
+                int checked, double maxError, bool ok )
+   {
+      printf( "%-7s SIMD %d %-22s %-10s interpolation %2d, %d threads: %6d pixels, max error %.3e %s\n",
+              m_typeName, m_level, what, PathName( path ), int( interpolation ), numberOfThreads,
+              checked, maxError, ok ? "ok" : "FAILED" );
+      if ( !ok )
+         ++m_failed;
+   }
+};
+
+/*
+ * All the checks of the sample type P. Returns the number of failed checks.
+ */
+template <class P>
+static int CheckType( const char* typeName )
+{
+   // Odd dimensions, so bands, tiles and bins don't divide the image evenly.
+   const int w = 157, h = 113;
+   TypeCheck<P> check( typeName, w, h );
+
+   const double a = Rad( 7.5 ), s = 1.04;
+   const double cx = w/2.0, cy = h/2.0;
+
+   const char* names[] =
+   { "integer translation", "sub-pixel translation", "negative translation", "affine", "projective" };
+   const Matrix transforms[] =
+   {
+      TranslationMatrix( 3.0, -5.0 ),
+      TranslationMatrix( 2.37, -1.61 ),
+      TranslationMatrix( -4.5, 0.25 ),
+      Matrix( s*Cos( a ), -s*Sin( a ), cx - s*(Cos( a )*cx - Sin( a )*cy) + 1.3,
+              s*Sin( a ),  s*Cos( a ), cy - s*(Sin( a )*cx + Cos( a )*cy) - 0.7,
+              0.0,         0.0,        1.0 ),
+      Matrix( 0.98,    0.05,   2.2,
+              -0.04,   1.01,  -1.9,
+              1.5e-04, -1.0e-04, 1.0 )
+   };
+
+   // Every CAPixelInterpolation mode except Auto.
+   const pcl_enum interpolations[] =
+   {
+      CAPixelInterpolation::NearestNeighbor,
+      CAPixelInterpolation::Bilinear,
+      CAPixelInterpolation::BicubicSpline,
+      CAPixelInterpolation::BicubicBSpline,
+      CAPixelInterpolation::Lanczos3,
+      CAPixelInterpolation::Lanczos4,
+      CAPixelInterpolation::Lanczos5,
+      CAPixelInterpolation::MitchellNetravaliFilter,
+      CAPixelInterpolation::CatmullRomSplineFilter,
+      CAPixelInterpolation::CubicBSplineFilter,
+      CAPixelInterpolation::FourierShift
+   };
+
+   // Only 16-bit and 32-bit float images have vector kernels.
+   const int top = SetWarpSIMDLevel( 2 );
+   for ( int level = top; level >= (WarpTraits<P>::Vectorized ? 0 : top); --level )
+   {
+      check.SetLevel( SetWarpSIMDLevel( level ) );
+
+      for ( int t = 0; t < int( ItemsInArray( transforms ) ); ++t )
+         for ( int i = 0; i < int( ItemsInArray( interpolations ) ); ++i )
+         {
+            check.Check( names[t], transforms[t], interpolations[i], ApplyPath, 1 );
+            for ( int path = ApplyPath; path < NumberOfPaths; ++path )
+               check.Check( names[t], transforms[t], interpolations[i], path, 3 );
+         }
+   }
+   SetWarpSIMDLevel( 2 );
+
+   // Whole-pixel shifts in place, with interpolating kernels and nearest neighbor.
+   const pcl_enum interpolating[] =
+   {
+      CAPixelInterpolation::Bilinear,
+      CAPixelInterpolation::BicubicSpline,
+      CAPixelInterpolation::Lanczos3,
+      CAPixelInterpolation::CatmullRomSplineFilter,
+      CAPixelInterpolation::FourierShift
+   };
+   for ( int i = 0; i < int( ItemsInArray( interpolating ) ); ++i )
+   {
+      check.CheckWholePixel( "whole-pixel shift", TranslationMatrix( -7.0, 4.0 ), TranslationMatrix( -7.0, 4.0 ), interpolating[i] );
+      check.CheckWholePixel( "near whole-pixel shift", TranslationMatrix( 5.0004, -2.9995 ), TranslationMatrix( 5.0, -3.0 ), interpolating[i] );
+      check.CheckWholePixel( "shift out of frame", TranslationMatrix( w + 10.0, 0.0 ), TranslationMatrix( w + 10.0, 0.0 ), interpolating[i] );
+   }
+   check.CheckWholePixel( "sub-pixel shift", TranslationMatrix( 2.37, -1.61 ), TranslationMatrix( 2.37, -1.61 ),
+                          CAPixelInterpolation::NearestNeighbor );
+
+   return check.Failed();
+}
+
+// ----------------------------------------------------------------------------
+
+int main()
+{
+   try
+   {
+      int failed = CheckType<UInt8PixelTraits>( "UInt8" )
+                 + CheckType<UInt16PixelTraits>( "UInt16" )
+                 + CheckType<UInt32PixelTraits>( "UInt32" )
+                 + CheckType<FloatPixelTraits>( "Float" )
+                 + CheckType<DoublePixelTraits>( "Double" );
+      if ( failed )
+      {
+         printf( "%d checks FAILED\n", failed );
+         return 1;
+      }
+      printf( "All checks passed.\n" );
+      return 0;
+   }
+   catch ( Exception& x )
+   {
+      printf( "%s\n", IsoString( x.Message() ).c_str() );
+      return 1;
+   }
+   catch ( ... )
+   {
+      printf( "Unexpected exception.\n" );
+      return 1;
+   }
+}
+
+// ****************************************************************************
+// EOF WarpEngineCheck.cpp - Released 2015/03/04 19:50:08 UTC